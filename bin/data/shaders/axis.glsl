@@ -7,8 +7,15 @@ layout(location = 1) in vec3 in_color;
 out vec3 color;
 
 uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
+
+layout(std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 time;
+};
 
 vec4 Position;
 
@@ -4,14 +4,20 @@
 layout(location = 0) in vec3 in_pos;
 layout(location = 1) in vec2 in_uv;
 layout(location = 2) in vec3 in_normal;
+layout(location = 8) in mat4 model; // per instance
 
 out vec3 pos;
 out vec2 uv;
 out vec3 normal;
 
-uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 time;
+};
 
 vec4 Position;
 
@@ -37,14 +43,22 @@ in vec3 normal;
 layout(location = 0) out vec4 out_color;
 
 uniform sampler2D texture0;
-uniform vec3      light_pos;
+
+layout(std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 time;
+};
 
 void main() {
 
     vec3 ambient = vec3(1, 1, 1);
-    vec3 diffuse = vec3(0.7, 0.6, 0.3); 
+    vec3 diffuse = light_color.rgb; 
 
-    vec3  dv   = light_pos - pos;
+    vec3  dv   = light_position.xyz - pos;
     float l    = length(dv);
     float att  = max(dot(normalize(dv), normal), 0) * 500 / (l * l);
 
@@ -8,10 +8,13 @@ opt="-O0"
 #dbg="-g"
 #con="-mwindows"
 def="-D OS_WINDOWS"
+#prf="-D PROFILER"
 etc="-std=c99 -pedantic -Wall -static"
 
-# build
-gcc $src $obj $fol $lin $opt $dbg $con $def $etc -o bin/$name &&
+# build, the win32 layer is its own translation unit so <windows.h> stays out of the unity build
+mkdir -p lib/object &&
+gcc src/layer/win32.c -O2 -c -D win32_layer_implementation -o $obj &&
+gcc $src $obj $fol $lin $opt $dbg $con $def $prf $etc -o bin/$name &&
 
 # run
 cd bin && ./$name && cd ..
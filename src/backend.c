@@ -55,9 +55,12 @@ typedef struct {
     s32 channel;
 
     u32 id;
+    u32 name; // interned path
 
 } Texture;
 
+Define_Handle(Texture);
+
 typedef struct {
     
     Vector2* vertices; // vertex buffer which contains all the character data
@@ -72,27 +75,119 @@ typedef struct {
 
 } MeshAlphabet;
 
+#define STREAM_FRAME_COUNT 3 // frames the GPU may lag behind before we wait
+
+// per-frame scratch GPU memory, split in one region per frame in flight
+typedef struct {
+
+    u32    id;
+    u32    target;
+    u64    frame_size;  // bytes per region
+    u8*    mapped;      // whole buffer, persistent, NULL when orphaning
+
+    u32    frame;       // current region
+    u64    head;        // write offset inside current region
+    GLsync fences[STREAM_FRAME_COUNT];
+
+} StreamBuffer;
+
 
 
 
 
 /* ==== Entity ==== */
 
+#define MESH_MAX_LODS 4
+
+// one tessellation level, every level of a mesh lives in the same pool
 typedef struct {
-    f32*    vertex_data;
+    u32 first_index; // sub-range in the pool's index buffer, in indices
+    u32 index_count;
+    s32 base_vertex; // sub-range in the pool's vertex buffer, added to every index
+    f32 error;       // how far the silhouette is off the real shape, relative to the bounding radius
+} MeshLOD;
+
+typedef struct {
+    f32*    vertex_data; // CPU copy of level 0, raw bytes if the vertex structure is not all f32
     u32*    indices;
     u32     vertex_data_count;
     u32     index_count;
+    u32     index_type;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT on the GPU, CPU copy is always u32
+    u32     pool;        // index into mesh_pools
+    MeshLOD lods[MESH_MAX_LODS]; // 0 is the full mesh, coarser after that
+    u32     lod_count;
+    AABB    bounds;  // local space, from the first vertex attribute
     Texture texture; // optional
     struct {
         u32 shader;
-        u32 vertex_array;
+        u32 vertex_array; // shared by every mesh in the same pool
         u32 vertices;
-        u32 indices; 
-        u32 texture; // todo: redundant now, as a Texture has it
+        u32 indices;
+        u32 texture;      // todo: redundant now, as a Texture has it
     } id;
 } Mesh;
 
+Define_Handle(Mesh);
+
+/*
+    vertex_structure entries are a component count, optionally or'ed with a storage format,
+    a plain count is 32-bit floats, so {3, 2, 3} still means what it always did,
+    integer formats are normalized, the shader sees floats either way
+*/
+#define VERTEX_COUNT_MASK 0xff
+#define VERTEX_FORMAT(a)  ((a) & ~VERTEX_COUNT_MASK)
+#define VERTEX_F32        (0 << 8)
+#define VERTEX_F16        (1 << 8)
+#define VERTEX_SNORM16    (2 << 8) // [-1, 1]
+#define VERTEX_UNORM16    (3 << 8) // [ 0, 1]
+#define VERTEX_SNORM8     (4 << 8)
+#define VERTEX_UNORM8     (5 << 8)
+#define VERTEX_SNORM10    (6 << 8) // GL_INT_2_10_10_10_REV, one u32, xyz 10 bits and w 2 bits, always 4 components to GL
+
+#define MESH_POOL_MAX_ATTRIBUTES 8
+#define MODEL_MATRIX_LOCATION    8 // per-instance mat4 at locations 8..11 in every pool, after the vertex attributes
+#define MESH_POOL_MAX_COUNT      8
+#define MESH_POOL_VERTEX_BYTES   (4 * 1024 * 1024)
+#define MESH_POOL_INDEX_BYTES    (2 * 1024 * 1024)
+
+// one VAO, vertex buffer and index buffer per vertex layout and index type, meshes are sub-ranges
+typedef struct {
+
+    u32 vertex_structure[MESH_POOL_MAX_ATTRIBUTES];
+    u32 vertex_structure_count;
+    u64 vertex_size;
+    u32 index_type;
+
+    struct {
+        u32 vertex_array;
+        u32 vertices;
+        u32 indices;
+    } id;
+
+    u64 vertex_capacity; // in vertices
+    u64 vertex_count;
+    u64 index_capacity;  // in indices
+    u64 index_count;
+
+} MeshPool;
+
+// generated geometry before it goes into a mesh, vertices are whatever the vertex structure says
+typedef struct {
+    f32* vertices;
+    u32* indices;
+    u32  vertex_count;
+    u32  index_count;
+} MeshData;
+
+// layout fixed by GL
+typedef struct {
+    u32 count;
+    u32 instance_count;
+    u32 first_index;
+    s32 base_vertex;
+    u32 base_instance;
+} DrawElementsIndirectCommand;
+
 typedef struct {
     Vector3 position;
     Vector3 scale;
@@ -100,8 +195,8 @@ typedef struct {
 } Entity3D;
 
 typedef struct {
-    Entity3D base;
-    Mesh*    mesh;
+    Entity3D     base;
+    Handle(Mesh) mesh;
 } Model3D;
 
 typedef struct {
@@ -130,6 +225,125 @@ typedef struct {
 
 
 
+/* ==== Uniform Blocks ==== */
+
+// std140 layout of the "Frame" block in the 3D shaders, keep both in sync,
+// only use mat4 and vec4 here so there are no padding surprises
+typedef struct {
+    Matrix4 projection;
+    Matrix4 view;
+    Vector4 camera_position; // w unused
+    Vector4 light_position;  // w unused
+    Vector4 light_color;     // w unused
+    Vector4 time;            // x: time, y: dt, zw unused
+} FrameUniforms;
+
+#define FRAME_UNIFORM_BINDING 0
+
+
+
+
+
+/* ==== Frame Pipeline ==== */
+
+/*
+    the simulation runs on its own thread one frame ahead of rendering:
+    the main thread polls GLFW, packs everything the simulation reads into an InputFrame and hands it over,
+    then draws the FrameState the simulation made from the previous input, while the simulation works on the next one
+
+    the main thread owns the window, GL and the temp allocator,
+    the simulation thread owns the camera, the scene and the speed scales, it must not call GLFW, GL or temp_*
+*/
+
+#define INPUT_MAX_EVENTS 32
+
+// keys the simulation reads, bits in InputFrame.keys
+enum {
+    INPUT_KEY_W = 1 << 0,
+    INPUT_KEY_A = 1 << 1,
+    INPUT_KEY_S = 1 << 2,
+    INPUT_KEY_D = 1 << 3,
+    INPUT_KEY_R = 1 << 4,
+    INPUT_KEY_F = 1 << 5,
+    INPUT_KEY_Q = 1 << 6,
+    INPUT_KEY_E = 1 << 7,
+};
+
+// one-off things from the GLFW callbacks, applied by the simulation in order
+enum {
+    INPUT_EVENT_DRAW_MODE,      // value: step
+    INPUT_EVENT_ENGINE_SPEED,   // value: scale
+    INPUT_EVENT_MOVEMENT_SPEED, // value: scale
+    INPUT_EVENT_PAUSE,
+    INPUT_EVENT_ZOOM,           // value: scroll delta
+    INPUT_EVENT_RESET_VIEW,
+};
+
+typedef struct {
+    u32 type;
+    f32 value;
+} InputEvent;
+
+// everything the simulation reads from the outside for one frame
+typedef struct {
+    f64        dt;
+    f64        mouse_dx;
+    f64        mouse_dy;
+    u32        keys;
+    s32        height; // of the window, in pixels
+    f32        aspect;
+    u8         cursor_visible;
+    u8         show_debug_info;
+    u8         quit;
+    u32        event_count;
+    InputEvent events[INPUT_MAX_EVENTS];
+} InputFrame;
+
+#define FRAME_MAX_MODELS 1024
+#define FRAME_MAX_TEXTS  16
+#define FRAME_TEXT_BYTES 4096
+
+typedef struct {
+    Vector2 position;
+    Vector2 scale;
+    Vector2 offset; // of the shadow
+    Vector4 color;
+    Vector4 shadow_color;
+    String  text;   // points into the FrameState's text_data
+} TextCommand;
+
+// everything the main thread draws for one frame, made by the simulation
+typedef struct {
+    Camera      camera; // interpolated, view and projection are ready
+    Vector3     light;
+    f64         time;
+    f64         dt;
+    Model3D     models[FRAME_MAX_MODELS]; // visible only, interpolated
+    u32         model_count;
+    TextCommand texts[FRAME_MAX_TEXTS];
+    u32         text_count;
+    u8          text_data[FRAME_TEXT_BYTES];
+    u64         text_used;
+    u8          show_debug_info;
+    u8          quit;   // last frame, the simulation thread is gone after this
+} FrameState;
+
+// two states so the simulation can write one while the other is drawn
+typedef struct {
+    FrameState states[2];
+    InputFrame input;       // one slot is enough, it is only written after the simulation took the last one
+    Semaphore  input_ready;
+    Semaphore  state_ready;
+    Semaphore  state_free;
+    u32        write;
+    u32        read;
+    Thread     thread;
+} FramePipeline;
+
+
+
+
+
 /* ==== Global Data ==== */
 
 
@@ -144,24 +358,34 @@ typedef struct {
 } Asset_Shaders;
 
 typedef struct {
-    Texture test;
-    Texture sun;
-    Texture stairway;
-    Texture styxel;
-    Texture styxel_8x8;
-    Texture sb_16x16;
-    Texture wood;
+    Handle(Texture) test;
+    Handle(Texture) sun;
+    Handle(Texture) stairway;
+    Handle(Texture) styxel;
+    Handle(Texture) styxel_8x8;
+    Handle(Texture) sb_16x16;
+    Handle(Texture) wood;
 } Asset_Textures;
 
+// interned at setup, see uniform_location()
+typedef struct {
+    u32 transform;
+    u32 color;
+    u32 position;
+    u32 offset;
+    u32 model;
+    u32 texture0;
+} Uniform_Names;
+
 typedef struct {
-    Mesh axis_arrow;
-    Mesh ring;
-    Mesh circle;
-    Mesh rectangle;
-    Mesh font_rectangle;
-    Mesh cube;
-    Mesh sphere;
-    Mesh tetrahedron;
+    Handle(Mesh) axis_arrow;
+    Handle(Mesh) ring;
+    Handle(Mesh) circle;
+    Handle(Mesh) rectangle;
+    Handle(Mesh) font_rectangle;
+    Handle(Mesh) cube;
+    Handle(Mesh) sphere;
+    Handle(Mesh) tetrahedron;
 } GeometryPrimitives;
 
 
@@ -169,12 +393,32 @@ typedef struct {
 
 /* ---- Data ---- */
 
+#define MESH_MAX_COUNT    256
+#define TEXTURE_MAX_COUNT 64
+
+// every Mesh and Texture lives in these, made at load time only, so the simulation thread may read them too
+Pool meshes;
+Pool textures;
+
 GeometryPrimitives geometry_primitives;
 Asset_Shaders      asset_shaders;
 Asset_Textures     asset_textures;
+Uniform_Names      uniform_names;
 
 MeshAlphabet       mesh_alphabet;
 
+MeshPool mesh_pools[MESH_POOL_MAX_COUNT];
+u32      mesh_pool_count;
+
+u32 frame_uniform_buffer;
+
+StreamBuffer stream_vertices;     // dynamic 2D vertices (text and batches)
+u32          stream_vertices_vao; // vec2 position at location 0, reads from stream_vertices
+StreamBuffer stream_instances;    // per-instance model matrices, every mesh pool VAO reads from here
+StreamBuffer stream_indirect;     // DrawElementsIndirectCommand
+
+InputFrame pending_input; // main thread, the callbacks add events here until the next gather_input()
+
 f64 time_now             = 0;
 f32 engine_speed_scale   = 1.0;
 f32 movement_speed_scale = 1.0;
@@ -204,7 +448,41 @@ Camera camera = {
 };
 
 
-Vector3 light; // temp
+Vector3 light;                                // temp
+Vector3 light_color = {0.7, 0.6, 0.3};        // temp
+
+
+
+
+/* ==== Handles ==== */
+
+Handle(Mesh) mesh_new() {
+    return (Handle(Mesh)) {pool_add(&meshes)};
+}
+
+// NULL for a stale handle
+Mesh* mesh_get(Handle(Mesh) h) {
+    return pool_get(&meshes, h.h);
+}
+
+Handle(Texture) texture_new() {
+    return (Handle(Texture)) {pool_add(&textures)};
+}
+
+// NULL for a stale handle
+Texture* texture_get(Handle(Texture) h) {
+    return pool_get(&textures, h.h);
+}
+
+// by interned path, {0} when it is not loaded, a u32 compare per texture.
+// the first match when a path is loaded more than once, every load_texture() gets its own texture
+Handle(Texture) texture_find(u32 name) {
+    for (u32 i = 0; i < textures.used; i++) {
+        Texture* t = pool_at(&textures, i);
+        if (t && t->name == name) return (Handle(Texture)) {{i, textures.generations[i]}};
+    }
+    return (Handle(Texture)) {0};
+}
 
 
 
@@ -291,6 +569,92 @@ void GL_print_debug_message(
 
 
 
+/* ==== GL: Counters ==== */
+
+/*
+    how much GL work a frame does, the baseline for every renderer optimization,
+    binds, uniforms and uploads are counted by wrapping the GLAD entry points below, so every call site counts,
+    draws go through count_draw() since only the call site knows the instance count (and the indirect commands)
+
+    render_counters is the frame being drawn, end_frame() moves it to render_counters_last,
+    loading before the first frame (make_mesh, load_texture) shows up in the first frame
+*/
+
+typedef struct {
+    u64 draw_calls;
+    u64 triangles;       // strips and fans too, points and lines count 0
+    u64 program_binds;
+    u64 texture_binds;
+    u64 uniform_uploads; // glUniform* calls, the Frame uniform block is in bytes_uploaded
+    u64 bytes_uploaded;  // glBufferData, glBufferSubData, glTexImage2D and writes to the stream buffers
+} RenderCounters;
+
+#define RENDER_COUNTER_COUNT (sizeof(RenderCounters) / sizeof(u64))
+
+char* render_counter_names[RENDER_COUNTER_COUNT] = {"draw_calls", "triangles", "program_binds", "texture_binds", "uniform_uploads", "bytes_uploaded"};
+
+RenderCounters render_counters;      // main thread
+RenderCounters render_counters_last; // main thread
+
+void count_triangles(s32 mode, u64 vertex_count, u64 instance_count) {
+    RenderCounters* c = &render_counters;
+    switch (mode) {
+        case GL_TRIANGLES:      c->triangles += vertex_count / 3 * instance_count; break;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN:   if (vertex_count > 2) c->triangles += (vertex_count - 2) * instance_count; break;
+    }
+}
+
+void count_draw(s32 mode, u64 vertex_count, u64 instance_count) {
+    render_counters.draw_calls++;
+    count_triangles(mode, vertex_count, instance_count);
+}
+
+u64 gl_pixel_size(u32 format, u32 type) {
+    
+    u64 components = 4;
+    switch (format) {
+        case GL_RED:  components = 1; break;
+        case GL_RG:   components = 2; break;
+        case GL_RGB:  components = 3; break;
+    }
+    
+    switch (type) {
+        case GL_FLOAT:          return components * 4;
+        case GL_HALF_FLOAT:
+        case GL_UNSIGNED_SHORT: return components * 2;
+    }
+    return components;
+}
+
+#undef  glUseProgram
+#undef  glBindTexture
+#undef  glUniform1i
+#undef  glUniform2fv
+#undef  glUniform4fv
+#undef  glUniformMatrix2fv
+#undef  glUniformMatrix4fv
+#undef  glBufferData
+#undef  glBufferSubData
+#undef  glBufferStorage
+#undef  glTexImage2D
+
+#define glUseProgram(p)                       (render_counters.program_binds++,   glad_glUseProgram(p))
+#define glBindTexture(t, id)                  (render_counters.texture_binds++,   glad_glBindTexture(t, id))
+#define glUniform1i(l, v)                     (render_counters.uniform_uploads++, glad_glUniform1i(l, v))
+#define glUniform2fv(l, n, v)                 (render_counters.uniform_uploads++, glad_glUniform2fv(l, n, v))
+#define glUniform4fv(l, n, v)                 (render_counters.uniform_uploads++, glad_glUniform4fv(l, n, v))
+#define glUniformMatrix2fv(l, n, t, v)        (render_counters.uniform_uploads++, glad_glUniformMatrix2fv(l, n, t, v))
+#define glUniformMatrix4fv(l, n, t, v)        (render_counters.uniform_uploads++, glad_glUniformMatrix4fv(l, n, t, v))
+#define glBufferData(t, size, data, usage)    (render_counters.bytes_uploaded += (data) ? (size) : 0, glad_glBufferData(t, size, data, usage))
+#define glBufferSubData(t, offset, size, data) (render_counters.bytes_uploaded += (size), glad_glBufferSubData(t, offset, size, data))
+#define glBufferStorage(t, size, data, flags)  (render_counters.bytes_uploaded += (data) ? (size) : 0, glad_glBufferStorage(t, size, data, flags))
+#define glTexImage2D(t, l, i, w, h, b, f, y, p) \
+    (render_counters.bytes_uploaded += (p) ? (u64) (w) * (h) * gl_pixel_size(f, y) : 0, glad_glTexImage2D(t, l, i, w, h, b, f, y, p))
+
+
+
+
 /* ==== Renderer: Utilities ==== */
 
 Matrix4 entity_to_m4(Entity3D e) {
@@ -300,26 +664,113 @@ Matrix4 entity_to_m4(Entity3D e) {
     );
 }
 
-void update_FPS_timer(Timer* t, f64 dt) {
-    t->base    += dt;
-    t->counter += t->interval;
-    if (t->base >= t->interval) {
-        t->base    = 0;
-        t->counter = 0;
+// transform local bounds by the entity, stays tight under rotation and non-uniform scale
+AABB entity_bounds(Entity3D e, AABB local) {
+
+    Matrix3 r = r3d_to_m3(e.orientation);
+    Vector3 c = aabb_center(local);
+    Vector3 h = v3_scale(v3_sub(local.max, local.min), 0.5);
+
+    Vector3 a0 = v3_scale(r.v0, e.scale.x);
+    Vector3 a1 = v3_scale(r.v1, e.scale.y);
+    Vector3 a2 = v3_scale(r.v2, e.scale.z);
+
+    Vector3 center = v3_add(e.position, v3_add(v3_add(v3_scale(a0, c.x), v3_scale(a1, c.y)), v3_scale(a2, c.z)));
+    Vector3 extent = {
+        fabsf(a0.x) * h.x + fabsf(a1.x) * h.y + fabsf(a2.x) * h.z,
+        fabsf(a0.y) * h.x + fabsf(a1.y) * h.y + fabsf(a2.y) * h.z,
+        fabsf(a0.z) * h.x + fabsf(a1.z) * h.y + fabsf(a2.z) * h.z,
+    };
+
+    return (AABB) {v3_sub(center, extent), v3_add(center, extent)};
+}
+
+AABB model_bounds(Model3D* model) {
+    return entity_bounds(model->base, mesh_get(model->mesh)->bounds);
+}
+
+Frustum camera_frustum(Camera* cam) {
+    return frustum_from_m4(m4_mul(cam->projection, cam->view));
+}
+
+// camera looks down its local y
+Ray camera_ray(Camera* cam) {
+    return (Ray) {cam->position, v3_rotate(V3_Y, cam->orientation)};
+}
+
+#define LOD_MAX_ERROR_PIXELS 0.5 // how far a coarser level may be off the full mesh on screen
+
+// bounding sphere of a world space box, projected, in pixels
+f32 projected_radius_pixels(Camera* cam, AABB b) {
+    
+    f32 radius   = v3_length(v3_sub(b.max, b.min)) * 0.5;
+    f32 distance = v3_length(v3_sub(aabb_center(b), cam->position));
+    if (distance <= radius) return window_info.height; // we are inside, whole screen
+    
+    return radius / (distance * tanf(cam->FOV * TAU / 720)) * window_info.height * 0.5;
+}
+
+// same for the 2D primitives, scale is the radius in NDC y (x gets divided by the aspect)
+f32 screen_radius_pixels(Vector2 scale) {
+    return fmaxf(fabsf(scale.x), fabsf(scale.y)) * window_info.height * 0.5;
+}
+
+// coarsest level that still looks the same at this size
+u32 mesh_select_lod(Mesh* mesh, f32 radius_pixels) {
+    u32 lod = 0;
+    for (u32 i = 1; i < mesh->lod_count; i++) {
+        if (mesh->lods[i].error * radius_pixels > LOD_MAX_ERROR_PIXELS) break;
+        lod = i;
     }
+    return lod;
+}
+
+u32 model_lod(Model3D* model, Camera* cam) {
+    Mesh* mesh = mesh_get(model->mesh);
+    if (mesh->lod_count < 2) return 0;
+    return mesh_select_lod(mesh, projected_radius_pixels(cam, model_bounds(model)));
+}
+
+// once per frame before any 3D drawing, every program with a "Frame" block reads from here
+void update_frame_uniforms(Camera* cam, Vector3 light_position, f64 time, f64 dt) {
+
+    FrameUniforms u = {
+        .projection      = cam->projection,
+        .view            = cam->view,
+        .camera_position = {cam->position.x, cam->position.y, cam->position.z, 1},
+        .light_position  = {light_position.x, light_position.y, light_position.z, 1},
+        .light_color     = {light_color.x, light_color.y, light_color.z, 1},
+        .time            = {time, dt, 0, 0},
+    };
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &u);
+}
+
+// FPS style, from the angles
+void update_camera_orientation(Camera* cam) {
+    
+    // zx -> yz -> xy (reverse is xy -> yz -> zx, so the "reverse order" in process_mouse_look() seems to be a thing?)
+    cam->orientation = r3d_mul(
+        r3d_mul(
+            r3d_from_plane_angle(B3_ZX, cam->zx), 
+            r3d_from_plane_angle(B3_YZ, cam->yz)
+        ),
+        r3d_from_plane_angle(B3_XY, cam->xy)
+    );
 }
 
-void update_camera_projection(Camera* cam) {
-    cam->projection = m4_perspective(cam->FOV * TAU / 360, window_info.aspect, cam->near, cam->far);
+void update_camera_projection(Camera* cam, f32 aspect) {
+    cam->projection = m4_perspective(cam->FOV * TAU / 360, aspect, cam->near, cam->far);
 }
 
+// the camera belongs to the simulation, it picks the new aspect up from the next InputFrame
 void resize_framebuffer(GLFWwindow* window, s32 width, s32 height) {
     WindowInfo* w = &window_info;
     glViewport(0, 0, width, height);
     w->width  = width;
     w->height = height;
     w->aspect = (f32) width / (f32) height;
-    update_camera_projection(&camera);
 }
 
 void toggle_vsync() {
@@ -400,278 +851,1567 @@ void pause_or_continue() {
 
 
 
-/* ==== Renderer ==== */
+/* ==== Renderer: Index Types ==== */
 
-/* ---- 2D ---- */
+// smallest index type that can address every vertex,
+// no GL_UNSIGNED_BYTE: most desktop GPUs convert byte indices on the CPU, and one type per size class keeps meshes batchable
+u32 index_type_for(u32 vertex_count) {
+    return vertex_count <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
 
-// todo: what's the better way to do position?
-void draw_rect(Vector2 position, Vector2 scale, Vector4 color) {
-    
-    Mesh* mesh = &geometry_primitives.rectangle;
+u32 index_type_size(u32 type) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        default:                return 4;
+    }
+}
 
-    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
-    m = m2_mul(m2_scale(scale), m);
-    
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
- 
-    glUniformMatrix2fv(glGetUniformLocation(mesh->id.shader, "transform"), 1, GL_FALSE, (f32*) &m);
-    
-    glUniform4fv(glGetUniformLocation(mesh->id.shader, "color"), 1, (f32*) &color);
-    glUniform2fv(glGetUniformLocation(mesh->id.shader, "position"), 1, (f32*) &position);
-    glDrawElements(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_INT, NULL);
 
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-}
 
-void draw_ring(Vector3 position, Vector2 scale, f32 line_width, Vector4 color) {
-    
-    Mesh* mesh = &geometry_primitives.ring;
+/* ==== Renderer: Vertex Formats ==== */
 
-    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
-    m = m2_mul(m2_scale(scale), m);
+// round to nearest even, overflow goes to infinity
+u16 f32_to_f16(f32 f) {
 
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    u32 x;
+    memcpy(&x, &f, sizeof(x));
 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
- 
-    glUniform2fv(glGetUniformLocation(mesh->id.shader, "position"), 1, (f32*) &position);
-    glUniformMatrix2fv(glGetUniformLocation(mesh->id.shader, "transform"), 1, GL_FALSE, (f32*) &m);
-    glUniform4fv(glGetUniformLocation(mesh->id.shader, "color"), 1, (f32*) &color);
-    
-    glLineWidth(line_width);
-    glDrawElements(GL_LINES, mesh->index_count, GL_UNSIGNED_INT, NULL);
-    glLineWidth(1);
+    u32 sign     = (x >> 16) & 0x8000;
+    u32 exponent = (x >> 23) & 0xff;
+    u32 mantissa = x & 0x7fffff;
+    s32 e        = (s32) exponent - 127 + 15;
 
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+    if (exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); // inf, nan
+    if (e >= 31)          return sign | 0x7c00;
+
+    u32 shift = 13;
+    if (e <= 0) {
+        if (e < -10) return sign; // too small even for a denormal
+        mantissa |= 0x800000;
+        shift     = 14 - e;
+        e         = 0;
+    }
+
+    u32 h    = ((u32) e << 10) | (mantissa >> shift);
+    u32 rest = mantissa & ((1u << shift) - 1);
+    u32 half = 1u << (shift - 1);
+    if (rest > half || (rest == half && (h & 1))) h++; // a carry into the exponent is still correct
+
+    return sign | h;
 }
 
-void draw_circle(Vector2 position, Vector2 scale, Vector4 color) {
-    
-    Mesh* mesh = &geometry_primitives.circle;
+f32 f16_to_f32(u16 h) {
 
-    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
-    m = m2_mul(m2_scale(scale), m);
+    u32 sign     = (u32) (h & 0x8000) << 16;
+    u32 exponent = (h >> 10) & 0x1f;
+    u32 mantissa = h & 0x3ff;
 
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (exponent == 0) {
+        f32 f = ldexpf(mantissa, -24);
+        return sign ? -f : f;
+    }
 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
- 
-    glUniform2fv(glGetUniformLocation(mesh->id.shader, "position"), 1, (f32*) &position);
-    glUniform4fv(glGetUniformLocation(mesh->id.shader, "color"), 1, (f32*) &color);
-    glUniformMatrix2fv(glGetUniformLocation(mesh->id.shader, "transform"), 1, GL_FALSE, (f32*) &m);
-    
-    glDrawElements(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_INT, NULL);
+    u32 x = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13) : sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    f32 f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
 
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+// components as GL sees them
+u32 vertex_attribute_components(u32 a) {
+    return VERTEX_FORMAT(a) == VERTEX_SNORM10 ? 4 : a & VERTEX_COUNT_MASK;
 }
 
+u32 vertex_attribute_size(u32 a) {
+    u32 count = a & VERTEX_COUNT_MASK;
+    switch (VERTEX_FORMAT(a)) {
+        case VERTEX_F16:
+        case VERTEX_SNORM16:
+        case VERTEX_UNORM16: return count * 2;
+        case VERTEX_SNORM8:
+        case VERTEX_UNORM8:  return count;
+        case VERTEX_SNORM10: return 4;
+        default:             return count * 4;
+    }
+}
 
-// todo: what's the better way to do position?
-// todo: texture leak bug?
-void draw_string(Vector2 position, Vector2 scale, Vector4 color, String s) {
-    
-    Mesh* mesh = &geometry_primitives.font_rectangle;
+u32 vertex_attribute_gl_type(u32 a) {
+    switch (VERTEX_FORMAT(a)) {
+        case VERTEX_F16:     return GL_HALF_FLOAT;
+        case VERTEX_SNORM16: return GL_SHORT;
+        case VERTEX_UNORM16: return GL_UNSIGNED_SHORT;
+        case VERTEX_SNORM8:  return GL_BYTE;
+        case VERTEX_UNORM8:  return GL_UNSIGNED_BYTE;
+        case VERTEX_SNORM10: return GL_INT_2_10_10_10_REV;
+        default:             return GL_FLOAT;
+    }
+}
 
-    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
-    m = m2_mul(m2_scale(scale), m);
+u8 vertex_attribute_normalized(u32 a) {
+    u32 format = VERTEX_FORMAT(a);
+    return format != VERTEX_F32 && format != VERTEX_F16;
+}
 
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
- 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
- 
-    glBindTexture(GL_TEXTURE_2D, asset_textures.styxel.id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glActiveTexture(GL_TEXTURE0);
- 
-    glUniform1i(glGetUniformLocation(mesh->id.shader, "texture0"), 0);
-    glUniformMatrix2fv(glGetUniformLocation(mesh->id.shader, "transform"), 1, GL_FALSE, (f32*) &m);
-    glUniform4fv(glGetUniformLocation(mesh->id.shader, "color"), 1, (f32*) &color);
-   
-    f32 rx = 0; // for newline 
-    for (u64 i = 0; i < s.count; i++) {
-    
-        u8 c = s.data[i];
-        switch (c) {
-            case '\t': {  
-                rx += 4.0;
-                continue;
-            }
-            case '\r': continue;
-            case '\n': { 
-                position.y -= scale.y;
-                rx = 0;
-                continue;
-            } 
-        }
+u64 vertex_structure_size(u32* vertex_structure, u32 count) {
+    u64 size = 0;
+    for (u32 i = 0; i < count; i++) size += vertex_attribute_size(vertex_structure[i]);
+    return size;
+}
 
-        s32 o = 16 * 1;
-        s32 row = (c - o) % 16;
-        s32 col = 6 - (c - o) / 16;
-        
-        Vector2 offset = {row / 16.0, col / 6.0};
-        Vector2 pos_offset = {position.x + scale.x * rx / window_info.aspect, position.y};
-        rx += 1.0;
+// out of range values get clamped, missing components are 0
+void vertex_attribute_write(u8* p, u32 a, f32* v, u32 count) {
+
+    u32 n = a & VERTEX_COUNT_MASK;
+    f32 c[4] = {0};
+    for (u32 i = 0; i < n && i < count && i < 4; i++) c[i] = v[i];
+
+    switch (VERTEX_FORMAT(a)) {
+        case VERTEX_F16:     for (u32 i = 0; i < n; i++) ((u16*) p)[i] = f32_to_f16(c[i]);                                  break;
+        case VERTEX_SNORM16: for (u32 i = 0; i < n; i++) ((s16*) p)[i] = roundf(clamp_f32(c[i], -1, 1) * 32767);           break;
+        case VERTEX_UNORM16: for (u32 i = 0; i < n; i++) ((u16*) p)[i] = roundf(clamp_f32(c[i],  0, 1) * 65535);           break;
+        case VERTEX_SNORM8:  for (u32 i = 0; i < n; i++) ((s8*)  p)[i] = roundf(clamp_f32(c[i], -1, 1) * 127);             break;
+        case VERTEX_UNORM8:  for (u32 i = 0; i < n; i++) ((u8*)  p)[i] = roundf(clamp_f32(c[i],  0, 1) * 255);             break;
+        case VERTEX_SNORM10: {
+            s32 x = roundf(clamp_f32(c[0], -1, 1) * 511);
+            s32 y = roundf(clamp_f32(c[1], -1, 1) * 511);
+            s32 z = roundf(clamp_f32(c[2], -1, 1) * 511);
+            s32 w = roundf(clamp_f32(c[3], -1, 1));
+            *(u32*) p = (x & 0x3ff) | (y & 0x3ff) << 10 | (z & 0x3ff) << 20 | (u32) (w & 0x3) << 30;
+            break;
+        }
+        default: memcpy(p, c, sizeof(f32) * n); break;
+    }
+}
 
-        glUniform2fv(glGetUniformLocation(mesh->id.shader, "position"), 1, (f32*) &pos_offset);
-        glUniform2fv(glGetUniformLocation(mesh->id.shader, "offset"), 1, (f32*) &offset);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL);
+Vector4 vertex_attribute_read(u8* p, u32 a) {
+
+    u32 n    = a & VERTEX_COUNT_MASK;
+    f32 c[4] = {0};
+
+    switch (VERTEX_FORMAT(a)) {
+        case VERTEX_F16:     for (u32 i = 0; i < n; i++) c[i] = f16_to_f32(((u16*) p)[i]);                     break;
+        case VERTEX_SNORM16: for (u32 i = 0; i < n; i++) c[i] = fmaxf(((s16*) p)[i] / 32767.0, -1);            break;
+        case VERTEX_UNORM16: for (u32 i = 0; i < n; i++) c[i] = ((u16*) p)[i] / 65535.0;                       break;
+        case VERTEX_SNORM8:  for (u32 i = 0; i < n; i++) c[i] = fmaxf(((s8*)  p)[i] / 127.0, -1);              break;
+        case VERTEX_UNORM8:  for (u32 i = 0; i < n; i++) c[i] = ((u8*)  p)[i] / 255.0;                         break;
+        case VERTEX_SNORM10: {
+            u32 x = *(u32*) p;
+            for (u32 i = 0; i < 3; i++) c[i] = fmaxf(((s32) (x >> (i * 10) << 22) >> 22) / 511.0, -1);
+            c[3] = fmaxf((s32) x >> 30, -1);
+            break;
+        }
+        default: memcpy(c, p, sizeof(f32) * n); break;
     }
 
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+    return (Vector4) {c[0], c[1], c[2], c[3]};
 }
 
-// todo: figure out offset scaling
-void draw_string_shadowed(Vector2 position, Vector2 offset, Vector2 scale, Vector4 fg_color, Vector4 bg_color, String s) {
-    draw_string(v2_add(position, offset), scale, bg_color, s);
-    draw_string(position,                 scale, fg_color, s);
+// float vertices described by from (plain counts) into the layout described by to, attribute by attribute, result is from heap_alloc()
+void* pack_vertices(f32* vertices, u32 vertex_count, u32* from, u32* to, u32 structure_count) {
+
+    u64 from_size = vertex_structure_size(from, structure_count);
+    u64 to_size   = vertex_structure_size(to,   structure_count);
+    u8* out       = heap_alloc(to_size * vertex_count, ALLOC_MESH);
+
+    for (u32 v = 0; v < vertex_count; v++) {
+        f32* src = (f32*) ((u8*) vertices + v * from_size);
+        u8*  dst = out + v * to_size;
+        for (u32 i = 0; i < structure_count; i++) {
+            assert(VERTEX_FORMAT(from[i]) == VERTEX_F32);
+            vertex_attribute_write(dst, to[i], src, from[i]);
+            src += from[i];
+            dst += vertex_attribute_size(to[i]);
+        }
+    }
+
+    return out;
 }
 
-// todo: further cleanup, move this to GPU?
-void draw_mesh_string(Vector2 position, Vector2 scale, Vector4 color, String s) {
 
-    MeshAlphabet* mesh = &mesh_alphabet;
 
-    Matrix2 m = m2_mul(m2_scale(scale), m2_scale((Vector2) {1 / window_info.aspect, 1}));
-    
-    u32 shader = asset_shaders.rect;
+
+/* ==== Renderer: Stream Buffers ==== */
+
+/*
+    with GL 4.4 (or ARB_buffer_storage) the buffer is mapped once, persistent and coherent,
+    we write straight into the region of the current frame and fence it at the end,
+    STREAM_FRAME_COUNT frames later we wait on that fence before writing there again
+
+    otherwise we orphan the buffer at the start of every frame and map unsynchronized ranges,
+    the driver hands us fresh storage so we never wait on a draw that is still in flight
+
+    when a frame writes more than a region holds we move on to a fresh region mid-frame,
+    a single write bigger than a region grows the buffer
+
+    usage:
+        u64   offset;
+        void* p = stream_buffer_map(&b, size, stride, &offset);
+        ... write ...
+        stream_buffer_unmap(&b);
+        glDrawArrays(..., offset / stride, ...);
+*/
+
+u8 stream_buffer_is_persistent() {
+    return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+}
+
+void stream_buffer_create(StreamBuffer* b) {
+
+    glGenBuffers(1, &b->id);
+    glBindBuffer(b->target, b->id);
+
+    if (stream_buffer_is_persistent()) {
+        u32 flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(b->target, b->frame_size * STREAM_FRAME_COUNT, NULL, flags);
+        b->mapped = glMapBufferRange(b->target, 0, b->frame_size * STREAM_FRAME_COUNT, flags);
+    } else {
+        glBufferData(b->target, b->frame_size, NULL, GL_STREAM_DRAW);
+    }
+}
+
+void stream_buffer_init(StreamBuffer* b, u32 target, u64 frame_size) {
+
+    *b = (StreamBuffer) {
+        .target     = target,
+        .frame_size = frame_size,
+    };
+
+    stream_buffer_create(b);
+
+    logprint("[Stream] %s, %llu bytes per frame\n", b->mapped ? "Persistent mapping" : "Orphaning", frame_size);
+}
+
+// waits until the GPU is done with the current region
+void stream_buffer_wait(StreamBuffer* b) {
+
+    GLsync fence = b->fences[b->frame];
+    if (!fence) return;
+
+    while (1) {
+        u32 r = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 * 1000);
+        if (r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED || r == GL_WAIT_FAILED) break;
+    }
+
+    glDeleteSync(fence);
+    b->fences[b->frame] = 0;
+}
+
+void stream_buffer_begin_frame(StreamBuffer* b) {
+
+    b->head = 0;
+
+    if (!b->mapped) {
+        glBindBuffer(b->target, b->id);
+        glBufferData(b->target, b->frame_size, NULL, GL_STREAM_DRAW);
+        return;
+    }
+
+    b->frame = (b->frame + 1) % STREAM_FRAME_COUNT;
+    stream_buffer_wait(b);
+}
+
+void stream_buffer_end_frame(StreamBuffer* b) {
+    if (!b->mapped) return;
+    b->fences[b->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// the region is full: fence what was drawn from it and carry on in the next one (or fresh storage when orphaning),
+// a frame that goes through every region ends up waiting on its own earlier draws, slow but correct
+void stream_buffer_next_region(StreamBuffer* b) {
+
+    b->head = 0;
+
+    if (!b->mapped) {
+        glBindBuffer(b->target, b->id);
+        glBufferData(b->target, b->frame_size, NULL, GL_STREAM_DRAW);
+        return;
+    }
+
+    b->fences[b->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    b->frame = (b->frame + 1) % STREAM_FRAME_COUNT;
+    stream_buffer_wait(b);
+}
+
+// VAOs hold on to the buffer name, so after a persistent buffer is replaced we point them at the new one
+void stream_buffer_attach(StreamBuffer* b) {
+
+    s32 bound;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &bound);
+
+    if (b == &stream_vertices && stream_vertices_vao) {
+        glBindVertexArray(stream_vertices_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, b->id);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*) 0);
+    }
+
+    if (b == &stream_instances) {
+        for (u32 p = 0; p < mesh_pool_count; p++) {
+            glBindVertexArray(mesh_pools[p].id.vertex_array);
+            glBindBuffer(GL_ARRAY_BUFFER, b->id);
+            for (u32 i = 0; i < 4; i++) {
+                glVertexAttribPointer(MODEL_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4), (void*) (i * sizeof(Vector4)));
+            }
+        }
+    }
+
+    glBindVertexArray(bound);
+}
+
+// a single upload bigger than a region, double until it fits.
+// the old buffer stays alive in the driver until the draws that read it are done, so nothing waits here
+void stream_buffer_grow(StreamBuffer* b, u64 size) {
+
+    while (b->frame_size < size) b->frame_size *= 2;
+    b->head = 0;
+
+    if (!b->mapped) {
+        glBindBuffer(b->target, b->id);
+        glBufferData(b->target, b->frame_size, NULL, GL_STREAM_DRAW);
+    } else {
+        for (u32 i = 0; i < STREAM_FRAME_COUNT; i++) {
+            if (b->fences[i]) glDeleteSync(b->fences[i]);
+            b->fences[i] = 0;
+        }
+        glBindBuffer(b->target, b->id);
+        glUnmapBuffer(b->target);
+        glDeleteBuffers(1, &b->id);
+        b->frame = 0;
+        stream_buffer_create(b);
+        stream_buffer_attach(b);
+    }
+
+    logprint("[Stream] Grew to %llu bytes per frame\n", b->frame_size);
+}
+
+// offset_out is from the start of the buffer, aligned to align (use the vertex stride, so offset / stride is a vertex index)
+void* stream_buffer_map(StreamBuffer* b, u64 size, u64 align, u64* offset_out) {
+
+    u64 start = (b->head + align - 1) / align * align;
+    if (start + size > b->frame_size) {
+        if (size > b->frame_size) stream_buffer_grow(b, size);
+        else                      stream_buffer_next_region(b);
+        start = 0;
+    }
+
+    b->head = start + size;
+    render_counters.bytes_uploaded += size;
+
+    if (b->mapped) {
+        *offset_out = b->frame * b->frame_size + start;
+        return b->mapped + *offset_out;
+    }
+
+    *offset_out = start;
+    glBindBuffer(b->target, b->id);
+    return glMapBufferRange(b->target, start, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void stream_buffer_unmap(StreamBuffer* b) {
+    if (b->mapped) return;
+    glBindBuffer(b->target, b->id);
+    glUnmapBuffer(b->target);
+}
+
+
+
+
+
+/* ==== Renderer: Uniforms ==== */
+
+/*
+    uniform locations by (program, interned name), so the driver's string lookup runs once per pair.
+    open addressing, program 0 is never a real one so it marks an empty slot, programs are never deleted so nothing goes stale
+*/
+
+#define UNIFORM_CACHE_SIZE 256 // power of 2, a handful of programs with a handful of uniforms each
+
+typedef struct {
+    u32 shader;
+    u32 name;
+    s32 location;
+} UniformSlot;
+
+UniformSlot uniform_cache[UNIFORM_CACHE_SIZE];
+u32         uniform_cache_count;
+
+s32 uniform_location(u32 shader, u32 name) {
+
+    u32 mask = UNIFORM_CACHE_SIZE - 1;
+    u32 i    = hash_u64(((u64) shader << 32) | name) & mask;
+    
+    for (; uniform_cache[i].shader; i = (i + 1) & mask) {
+        UniformSlot* s = &uniform_cache[i];
+        if (s->shader == shader && s->name == name) return s->location;
+    }
+
+    if (uniform_cache_count * 2 >= UNIFORM_CACHE_SIZE) error("[GLSL] Uniform cache full, raise UNIFORM_CACHE_SIZE\n");
+    uniform_cache_count++;
+
+    s32 location = glGetUniformLocation(shader, (char*) intern_string(name).data); // -1 when it is not there, GL ignores those
+    uniform_cache[i] = (UniformSlot) {shader, name, location};
+    return location;
+}
+
+
+
+
+/* ==== Renderer: Pass Timers ==== */
+
+/*
+    GPU time per render pass from GL_TIME_ELAPSED queries, next to the CPU time the main thread spent submitting it,
+    a frame's queries are read GPU_TIMER_FRAMES - 1 frames later so reading never waits on the GPU,
+    a result that is still not there by then is dropped (the old number stays on screen).
+    only one GL_TIME_ELAPSED query can run at a time, so passes must not nest
+*/
+
+#define GPU_TIMER_FRAMES 4
+
+typedef enum {
+    RENDER_PASS_3D,
+    RENDER_PASS_TEXT,
+    RENDER_PASS_HUD,
+    RENDER_PASS_COUNT,
+} RenderPass;
+
+char* render_pass_names[RENDER_PASS_COUNT] = {"3D", "Text", "HUD"};
+
+typedef struct {
+    u32 queries[GPU_TIMER_FRAMES][RENDER_PASS_COUNT];
+    u8  pending[GPU_TIMER_FRAMES][RENDER_PASS_COUNT];
+    u32 slot;
+    f64 cpu_start;
+    f64 gpu_ms[RENDER_PASS_COUNT]; // latest result, a few frames old
+    f64 cpu_ms[RENDER_PASS_COUNT]; // last frame
+} PassTimers;
+
+PassTimers pass_timers;
+
+void pass_timers_init() {
+    glGenQueries(GPU_TIMER_FRAMES * RENDER_PASS_COUNT, &pass_timers.queries[0][0]);
+}
+
+// start of a frame, takes the oldest slot and reads what it measured
+void pass_timers_collect() {
+
+    PassTimers* t = &pass_timers;
+    t->slot = (t->slot + 1) % GPU_TIMER_FRAMES;
+    
+    for (u32 p = 0; p < RENDER_PASS_COUNT; p++) {
+        
+        if (!t->pending[t->slot][p]) continue;
+        t->pending[t->slot][p] = 0;
+        
+        u32 q = t->queries[t->slot][p];
+        s32 available = 0;
+        glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+
+        GLuint64 ns;
+        glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+        t->gpu_ms[p] = ns / 1e6;
+    }
+}
+
+void pass_begin(RenderPass p) {
+    PassTimers* t = &pass_timers;
+    profile_begin(render_pass_names[p]);
+    t->cpu_start = glfwGetTime();
+    glBeginQuery(GL_TIME_ELAPSED, t->queries[t->slot][p]);
+}
+
+void pass_end(RenderPass p) {
+    PassTimers* t = &pass_timers;
+    glEndQuery(GL_TIME_ELAPSED);
+    t->pending[t->slot][p] = 1;
+    t->cpu_ms[p] = (glfwGetTime() - t->cpu_start) * 1000;
+    profile_end();
+}
+
+
+
+
+/* ==== Renderer: Frame ==== */
+
+void begin_frame() {
+    pass_timers_collect();
+    stream_buffer_begin_frame(&stream_vertices);
+    stream_buffer_begin_frame(&stream_instances);
+    stream_buffer_begin_frame(&stream_indirect);
+}
+
+void end_frame() {
+    stream_buffer_end_frame(&stream_vertices);
+    stream_buffer_end_frame(&stream_instances);
+    stream_buffer_end_frame(&stream_indirect);
+    render_counters_last = render_counters;
+    render_counters      = (RenderCounters) {0};
+}
+
+
+
+
+/* ==== Renderer ==== */
+
+// the mesh's VAO (its pool's) has to be bound
+void draw_mesh_elements(Mesh* mesh, u32 lod, s32 mode) {
+    MeshLOD* l = &mesh->lods[lod];
+    u64 offset = (u64) l->first_index * index_type_size(mesh->index_type);
+    glDrawElementsBaseVertex(mode, l->index_count, mesh->index_type, (void*) offset, l->base_vertex);
+    count_draw(mode, l->index_count, 1);
+}
+
+u8 has_base_instance() {
+    return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_base_instance;
+}
+
+u8 has_multi_draw_indirect() {
+    return GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect;
+}
+
+// without base instance we point the instance attributes of the bound VAO at the data instead
+void bind_instance_offset(u64 offset) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream_instances.id);
+    for (u32 i = 0; i < 4; i++) {
+        glVertexAttribPointer(MODEL_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4), (void*) (offset + i * sizeof(Vector4)));
+    }
+}
+
+// draws instance_count copies, reading model matrices from stream_instances at instance_offset (bytes)
+void draw_mesh_instanced(Mesh* mesh, u32 lod, s32 mode, u32 instance_count, u64 instance_offset) {
+    
+    MeshLOD* l = &mesh->lods[lod];
+    u64 offset = (u64) l->first_index * index_type_size(mesh->index_type);
+    
+    if (has_base_instance()) {
+        glDrawElementsInstancedBaseVertexBaseInstance(
+            mode, l->index_count, mesh->index_type, (void*) offset,
+            instance_count, l->base_vertex, instance_offset / sizeof(Matrix4)
+        );
+    } else {
+        bind_instance_offset(instance_offset);
+        glDrawElementsInstancedBaseVertex(mode, l->index_count, mesh->index_type, (void*) offset, instance_count, l->base_vertex);
+    }
+    count_draw(mode, l->index_count, instance_count);
+}
+
+
+/* ---- 2D ---- */
+
+// todo: what's the better way to do position?
+void draw_rect(Vector2 position, Vector2 scale, Vector4 color) {
+    
+    Mesh* mesh = mesh_get(geometry_primitives.rectangle);
+
+    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
+    m = m2_mul(m2_scale(scale), m);
+    
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+ 
+    glUniformMatrix2fv(uniform_location(mesh->id.shader, uniform_names.transform), 1, GL_FALSE, (f32*) &m);
+    
+    glUniform4fv(uniform_location(mesh->id.shader, uniform_names.color), 1, (f32*) &color);
+    glUniform2fv(uniform_location(mesh->id.shader, uniform_names.position), 1, (f32*) &position);
+    draw_mesh_elements(mesh, 0, GL_TRIANGLES);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void draw_ring(Vector3 position, Vector2 scale, f32 line_width, Vector4 color) {
+    
+    Mesh* mesh = mesh_get(geometry_primitives.ring);
+
+    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
+    m = m2_mul(m2_scale(scale), m);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+ 
+    glUniform2fv(uniform_location(mesh->id.shader, uniform_names.position), 1, (f32*) &position);
+    glUniformMatrix2fv(uniform_location(mesh->id.shader, uniform_names.transform), 1, GL_FALSE, (f32*) &m);
+    glUniform4fv(uniform_location(mesh->id.shader, uniform_names.color), 1, (f32*) &color);
+    
+    glLineWidth(line_width);
+    draw_mesh_elements(mesh, mesh_select_lod(mesh, screen_radius_pixels(scale)), GL_LINES);
+    glLineWidth(1);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void draw_circle(Vector2 position, Vector2 scale, Vector4 color) {
+    
+    Mesh* mesh = mesh_get(geometry_primitives.circle);
+
+    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
+    m = m2_mul(m2_scale(scale), m);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+ 
+    glUniform2fv(uniform_location(mesh->id.shader, uniform_names.position), 1, (f32*) &position);
+    glUniform4fv(uniform_location(mesh->id.shader, uniform_names.color), 1, (f32*) &color);
+    glUniformMatrix2fv(uniform_location(mesh->id.shader, uniform_names.transform), 1, GL_FALSE, (f32*) &m);
+    
+    draw_mesh_elements(mesh, mesh_select_lod(mesh, screen_radius_pixels(scale)), GL_TRIANGLES);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+
+// todo: what's the better way to do position?
+// todo: texture leak bug?
+void draw_string(Vector2 position, Vector2 scale, Vector4 color, String s) {
+    
+    Mesh* mesh = mesh_get(geometry_primitives.font_rectangle);
+
+    Matrix2 m = m2_scale((Vector2) {1 / window_info.aspect, 1});
+    m = m2_mul(m2_scale(scale), m);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+ 
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+ 
+    glBindTexture(GL_TEXTURE_2D, texture_get(asset_textures.styxel)->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+ 
+    glUniform1i(uniform_location(mesh->id.shader, uniform_names.texture0), 0);
+    glUniformMatrix2fv(uniform_location(mesh->id.shader, uniform_names.transform), 1, GL_FALSE, (f32*) &m);
+    glUniform4fv(uniform_location(mesh->id.shader, uniform_names.color), 1, (f32*) &color);
+   
+    f32 rx = 0; // for newline 
+    for (u64 i = 0; i < s.count; i++) {
+    
+        u8 c = s.data[i];
+        switch (c) {
+            case '\t': {  
+                rx += 4.0;
+                continue;
+            }
+            case '\r': continue;
+            case '\n': { 
+                position.y -= scale.y;
+                rx = 0;
+                continue;
+            } 
+        }
+
+        s32 o = 16 * 1;
+        s32 row = (c - o) % 16;
+        s32 col = 6 - (c - o) / 16;
+        
+        Vector2 offset = {row / 16.0, col / 6.0};
+        Vector2 pos_offset = {position.x + scale.x * rx / window_info.aspect, position.y};
+        rx += 1.0;
+
+        glUniform2fv(uniform_location(mesh->id.shader, uniform_names.position), 1, (f32*) &pos_offset);
+        glUniform2fv(uniform_location(mesh->id.shader, uniform_names.offset), 1, (f32*) &offset);
+        draw_mesh_elements(mesh, 0, GL_TRIANGLES);
+    }
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// todo: figure out offset scaling
+void draw_string_shadowed(Vector2 position, Vector2 offset, Vector2 scale, Vector4 fg_color, Vector4 bg_color, String s) {
+    draw_string(v2_add(position, offset), scale, bg_color, s);
+    draw_string(position,                 scale, fg_color, s);
+}
+
+// builds the whole string on the CPU into the stream buffer, one draw per string
+void draw_mesh_string(Vector2 position, Vector2 scale, Vector4 color, String s) {
+
+    MeshAlphabet* mesh = &mesh_alphabet;
+
+    Matrix2 m = m2_mul(m2_scale(scale), m2_scale((Vector2) {1 / window_info.aspect, 1}));
+    
+    u64 total = 0;
+    for (u64 i = 0; i < s.count; i++) total += mesh->indices[s.data[i]].count;
+    if (!total) return;
+
+    profile_begin("draw_mesh_string");
+
+    u64 offset;
+    Vector2* out = stream_buffer_map(&stream_vertices, sizeof(Vector2) * total, sizeof(Vector2), &offset);
+    
+    u64 acc = 0;
+    f32 rx  = 0; // for newline 
+    for (u64 i = 0; i < s.count; i++) {
+        
+        u8 c = s.data[i];
+        switch (c) {
+            case '\t': {  
+                rx += 4.0;
+                continue;
+            }
+            case '\r': continue;
+            case '\n': { 
+                position.y -= scale.y;
+                rx = 0;
+                continue;
+            } 
+        }
+        
+        Vector2 pos = {position.x + scale.x * rx / window_info.aspect, position.y};
+        rx += 1.0;
+        
+        Vector2* v = mesh->vertices + mesh->indices[c].start;
+        for (u32 j = 0; j < mesh->indices[c].count; j++) {
+            out[acc++] = (Vector2) {
+                m.v0.x * v[j].x + m.v1.x * v[j].y + pos.x,
+                m.v0.y * v[j].x + m.v1.y * v[j].y + pos.y,
+            };
+        }
+    }
+
+    stream_buffer_unmap(&stream_vertices);
+
+    u32 shader = asset_shaders.rect;
     glUseProgram(shader);
     
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    glBindVertexArray(stream_vertices_vao);
+    
+    Vector2 zero = {0, 0};
+    glUniform4fv(uniform_location(shader, uniform_names.color),    1, (f32*) &color);
+    glUniformMatrix2fv(uniform_location(shader, uniform_names.transform), 1, GL_FALSE, (f32*) &M2_IDENTITY);
+    glUniform2fv(uniform_location(shader, uniform_names.position), 1, (f32*) &zero);
+    
+    glDrawArrays(GL_TRIANGLES, offset / sizeof(Vector2), acc);
+    count_draw(GL_TRIANGLES, acc, 1);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+
+    profile_end();
+}
+
+void draw_mesh_string_shadowed(Vector2 position, Vector2 offset, Vector2 scale, Vector4 fg_color, Vector4 bg_color, String s) {
+    draw_mesh_string(v2_add(position, offset), scale, bg_color, s);
+    draw_mesh_string(position,                 scale, fg_color, s);
+}
+
+
+
+
+/* ---- 3D ---- */
+
+void draw_axis_arrow(Vector3 scale, Camera* cam) {
+
+    Mesh* mesh = mesh_get(geometry_primitives.axis_arrow);
+
+    Vector3 position = v3_add(cam->position, v3_rotate(V3_Y, cam->orientation));
+
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+    
+    Matrix4 m = m4_mul(m4_translate(position), m4_scale(scale));
+    glUniformMatrix4fv(uniform_location(mesh->id.shader, uniform_names.model), 1, GL_FALSE, (f32*) &m);
+    
+    glDisable(GL_DEPTH_TEST);
+    glLineWidth(2);
+   
+    draw_mesh_elements(mesh, 0, GL_LINES);
+    
+    glEnable(GL_DEPTH_TEST);
+    glLineWidth(1);
+}
+
+void bind_model_material(Mesh* mesh) {
+
+    glUseProgram(mesh->id.shader); 
+    glBindVertexArray(mesh->id.vertex_array);
+    
+    glBindTexture(GL_TEXTURE_2D, mesh->id.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(uniform_location(mesh->id.shader, uniform_names.texture0), 0);
+}
+
+// every model must use the same mesh, camera and light come from the frame uniform block, see update_frame_uniforms()
+void draw_model(Model3D* model, s32 count, Camera* cam) {
+    
+    if (count <= 0) return;
+
+    profile_begin("draw_model");
+
+    Mesh* mesh = mesh_get(model->mesh);
+
+    // level per instance, then matrices bucketed by level so each level is one instanced draw
+    u8* lods = temp_alloc(count);
+    u32 lod_start[MESH_MAX_LODS] = {0};
+    u32 lod_count[MESH_MAX_LODS] = {0};
+    for (s32 i = 0; i < count; i++) {
+        lods[i] = model_lod(&model[i], cam);
+        lod_count[lods[i]]++;
+    }
+    for (u32 l = 1; l < MESH_MAX_LODS; l++) lod_start[l] = lod_start[l - 1] + lod_count[l - 1];
+
+    u64 offset;
+    Matrix4* m = stream_buffer_map(&stream_instances, sizeof(Matrix4) * count, sizeof(Matrix4), &offset);
+    {
+        u32 fill[MESH_MAX_LODS];
+        memcpy(fill, lod_start, sizeof(fill));
+        for (s32 i = 0; i < count; i++) m[fill[lods[i]]++] = entity_to_m4(model[i].base);
+    }
+    stream_buffer_unmap(&stream_instances);
+
+    bind_model_material(mesh);
+    for (u32 l = 0; l < MESH_MAX_LODS; l++) {
+        if (!lod_count[l]) continue;
+        draw_mesh_instanced(mesh, l, cam->draw_mode, lod_count[l], offset + lod_start[l] * sizeof(Matrix4));
+    }
+
+    temp_free(count);
+
+    profile_end();
+}
+
+typedef struct {
+    Mesh* mesh;
+    u32   lod;
+    u32   model;
+} ModelSortKey;
+
+// material first (program, texture, vertex layout), then mesh and level, so equal draws end up next to each other
+int compare_model_sort_keys(const void* pa, const void* pb) {
+    
+    ModelSortKey* ka = (ModelSortKey*) pa;
+    ModelSortKey* kb = (ModelSortKey*) pb;
+    Mesh* a = ka->mesh;
+    Mesh* b = kb->mesh;
+    
+    if (a->id.shader       != b->id.shader)       return a->id.shader       < b->id.shader       ? -1 : 1;
+    if (a->id.texture      != b->id.texture)      return a->id.texture      < b->id.texture      ? -1 : 1;
+    if (a->id.vertex_array != b->id.vertex_array) return a->id.vertex_array < b->id.vertex_array ? -1 : 1;
+    if (a != b)                                   return a < b ? -1 : 1;
+    if (ka->lod != kb->lod)                       return ka->lod < kb->lod ? -1 : 1;
+    
+    return 0;
+}
+
+// models may use any mesh, one glMultiDrawElementsIndirect per material (GL 4.3),
+// a loop of instanced base vertex draws per material otherwise
+void draw_models(Model3D** models, u32 count, Camera* cam) {
+
+    if (!count) return;
+
+    ModelSortKey* keys = temp_alloc(sizeof(ModelSortKey) * count);
+    for (u32 i = 0; i < count; i++) keys[i] = (ModelSortKey) {mesh_get(models[i]->mesh), model_lod(models[i], cam), i};
+    qsort(keys, count, sizeof(ModelSortKey), compare_model_sort_keys);
+
+    // all matrices in sorted order, so every run of one mesh is a contiguous instance range
+    u64 instance_offset;
+    Matrix4* m = stream_buffer_map(&stream_instances, sizeof(Matrix4) * count, sizeof(Matrix4), &instance_offset);
+    for (u32 i = 0; i < count; i++) m[i] = entity_to_m4(models[keys[i].model]->base);
+    stream_buffer_unmap(&stream_instances);
+
+    // one command per run of equal meshes and levels, worst case one per model
+    DrawElementsIndirectCommand* commands = temp_alloc(sizeof(DrawElementsIndirectCommand) * count);
+    u8 use_indirect = has_multi_draw_indirect();
+
+    u32 group_start = 0;
+    while (group_start < count) {
+
+        Mesh* first = keys[group_start].mesh;
+
+        u32 command_count = 0;
+        u32 i = group_start;
+        for (; i < count; i++) {
+            
+            Mesh* mesh = keys[i].mesh;
+            if (mesh->id.shader       != first->id.shader)       break;
+            if (mesh->id.texture      != first->id.texture)      break;
+            if (mesh->id.vertex_array != first->id.vertex_array) break;
+
+            if (i > group_start && mesh == keys[i - 1].mesh && keys[i].lod == keys[i - 1].lod) {
+                commands[command_count - 1].instance_count++;
+                continue;
+            }
+
+            MeshLOD* l = &mesh->lods[keys[i].lod];
+            commands[command_count++] = (DrawElementsIndirectCommand) {
+                .count          = l->index_count,
+                .instance_count = 1,
+                .first_index    = l->first_index,
+                .base_vertex    = l->base_vertex,
+                .base_instance  = instance_offset / sizeof(Matrix4) + i,
+            };
+        }
+
+        bind_model_material(first);
+
+        if (use_indirect) {
+            
+            u64 offset;
+            void* p = stream_buffer_map(&stream_indirect, sizeof(DrawElementsIndirectCommand) * command_count, sizeof(DrawElementsIndirectCommand), &offset);
+            memcpy(p, commands, sizeof(DrawElementsIndirectCommand) * command_count);
+            stream_buffer_unmap(&stream_indirect);
+
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream_indirect.id);
+            glMultiDrawElementsIndirect(cam->draw_mode, first->index_type, (void*) offset, command_count, 0);
+            render_counters.draw_calls++;
+            for (u32 j = 0; j < command_count; j++) count_triangles(cam->draw_mode, commands[j].count, commands[j].instance_count);
+
+        } else {
+
+            u64 index_size = index_type_size(first->index_type);
+            for (u32 j = 0; j < command_count; j++) {
+                DrawElementsIndirectCommand* c = &commands[j];
+                bind_instance_offset((u64) c->base_instance * sizeof(Matrix4));
+                glDrawElementsInstancedBaseVertex(
+                    cam->draw_mode, c->count, first->index_type, (void*) (c->first_index * index_size),
+                    c->instance_count, c->base_vertex
+                );
+                count_draw(cam->draw_mode, c->count, c->instance_count);
+            }
+        }
+
+        group_start = i;
+    }
+
+    temp_free(sizeof(DrawElementsIndirectCommand) * count);
+    temp_free(sizeof(ModelSortKey) * count);
+}
+
+
+
+
+
+
+
+/* ==== Benchmark ==== */
+
+/*
+    --bench                 run a fixed number of frames with a fixed dt in a hidden window, write the results and exit
+    --frames <count>        frames to run, default BENCH_DEFAULT_FRAMES
+    --out <file>            where the results go, default data/bench.json
+    --path <file>           camera path to replay, default data/camera.path, without one the camera turns in place
+    --record-path           normal run, saves the camera every simulation step to the path file on exit
+    --record-input <file>   saves every InputFrame to a binary log on exit, see Input Log
+    --frame-csv <file>      writes the time of every frame as CSV on exit, see Frame Stats
+    --replay-input <file>   feeds a recorded log to the simulation instead of live input, quits at its end,
+                            with --bench the log decides the frame count and dt, and the camera path is not used
+    --trace <file>          captures profiler zones of the whole run as Chrome trace JSON (needs PROFILER, F4 captures TRACE_HOTKEY_FRAMES)
+    --bench-map             times the runtime's hash map against a linear search at our table sizes, logs it and exits
+
+    the results are plain JSON with a fixed key order, so two runs can be diffed.
+    the results and path files are opened at startup, so a bad path fails before the run and not after it.
+    the path is recorded and replayed per simulation step (SIM_DT), so it plays back the same whatever the frame rate was
+*/
+
+#define BENCH_DEFAULT_FRAMES 1000
+#define BENCH_WARMUP         16 // frames left out of the statistics, shader and driver warm up
+#define BENCH_DT             (1.0 / 60)
+#define TRACE_HOTKEY_FRAMES  120 // F4 writes these to data/trace.json
+
+typedef struct {
+    u8    enabled;
+    u8    record_path;
+    u8    map;
+    u32   frames;
+    char* out_path;
+    char* camera_path;
+    char* record_input;
+    char* replay_input;
+    char* trace_path;
+    char* frame_csv;
+} BenchOptions;
+
+// one per simulation step
+typedef struct {
+    Vector3 position;
+    Rotor3D orientation;
+    f32     yz;
+    f32     zx;
+    f32     xy;
+} CameraPose;
+
+typedef struct {
+    CameraPose* poses;
+    u32         count;
+    u32         allocated;
+    FILE*       file; // open while recording
+} CameraPath;
+
+// main thread, one entry per rendered frame
+typedef struct {
+    f64* frame_ms;
+    RenderCounters* counters;
+    u64*            heap_allocations;
+    u32  count;
+    FILE* out;
+} BenchResults;
+
+BenchOptions bench_options = {
+    .frames      = BENCH_DEFAULT_FRAMES,
+    .out_path    = "data/bench.json",
+    .camera_path = "data/camera.path",
+};
+
+CameraPath camera_path; // simulation thread while running
+
+void parse_command_line() {
+
+    BenchOptions* o = &bench_options;
+    Array(String) args = runtime.command_line_args;
+
+    for (u64 i = 1; i < args.count; i++) {
+        
+        char* a    = (char*) args.data[i].data;
+        char* next = i + 1 < args.count ? (char*) args.data[i + 1].data : NULL;
+
+        if      (!strcmp(a, "--bench"))                 o->enabled     = 1;
+        else if (!strcmp(a, "--record-path"))           o->record_path = 1;
+        else if (!strcmp(a, "--bench-map"))             o->map         = 1;
+        else if (!strcmp(a, "--frames") && next)      { o->frames      = strtoul(next, NULL, 10); i++; }
+        else if (!strcmp(a, "--out")    && next)      { o->out_path    = next; i++; }
+        else if (!strcmp(a, "--path")   && next)      { o->camera_path = next; i++; }
+        else if (!strcmp(a, "--record-input") && next) { o->record_input = next; i++; }
+        else if (!strcmp(a, "--replay-input") && next) { o->replay_input = next; i++; }
+        else if (!strcmp(a, "--trace") && next)        { o->trace_path = next; i++; }
+        else if (!strcmp(a, "--frame-csv") && next)    { o->frame_csv = next; i++; }
+        else logprint("[Setup] [Warning] Unknown argument %s\n", a);
+    }
+
+    if (o->enabled && o->frames <= BENCH_WARMUP) o->frames = BENCH_WARMUP + 1;
+}
+
+void camera_path_record(CameraPath* p, Camera* cam) {
+    if (p->count == p->allocated) {
+        p->allocated = p->allocated ? p->allocated * 2 : 1024;
+        p->poses     = heap_realloc(p->poses, sizeof(CameraPose) * p->allocated, ALLOC_DEBUG);
+    }
+    p->poses[p->count++] = (CameraPose) {cam->position, cam->orientation, cam->yz, cam->zx, cam->xy};
+}
+
+// loops if the path is shorter than the run, turns once around in place over the run if there is no path
+// (BENCH_DT is SIM_DT, so a run takes about one step per frame)
+void camera_path_apply(CameraPath* p, u64 step, Camera* cam) {
+    
+    if (!p->count) {
+        cam->xy = TAU * step / (f32) bench_options.frames;
+        update_camera_orientation(cam);
+        return;
+    }
+
+    CameraPose* pose = &p->poses[step % p->count];
+    cam->position    = pose->position;
+    cam->orientation = pose->orientation;
+    cam->yz          = pose->yz;
+    cam->zx          = pose->zx;
+    cam->xy          = pose->xy;
+}
+
+void load_camera_path(CameraPath* p, char* path) {
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        logprint("[Bench] No camera path at %s, turning in place\n", path);
+        return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    u64 count = ftell(f) / sizeof(CameraPose);
+    fseek(f, 0, SEEK_SET);
+
+    p->poses     = heap_alloc(sizeof(CameraPose) * count, ALLOC_DEBUG);
+    p->count     = fread(p->poses, sizeof(CameraPose), count, f);
+    p->allocated = count;
+    fclose(f);
+
+    logprint("[Bench] Camera path %s: %u steps\n", path, p->count);
+}
+
+void camera_path_begin_record(CameraPath* p, char* path) {
+    p->file = fopen(path, "wb");
+    if (!p->file) error("[Bench] Cannot open %s\n", path);
+}
+
+void save_camera_path(CameraPath* p, char* path) {
+    fwrite(p->poses, sizeof(CameraPose), p->count, p->file);
+    fclose(p->file);
+    p->file = NULL;
+    logprint("[Bench] Camera path saved to %s: %u steps\n", path, p->count);
+}
+
+// what the simulation sees in a benchmark run, no live input at all
+InputFrame bench_input(u32 frame) {
+
+    WindowInfo* w = &window_info;
+    
+    pending_input.event_count = 0;
+    
+    return (InputFrame) {
+        .dt              = BENCH_DT,
+        .height          = w->height,
+        .aspect          = w->aspect,
+        .show_debug_info = w->show_debug_info,
+        .quit            = frame >= bench_options.frames,
+    };
+}
+
+void bench_results_init(BenchResults* r, u32 frames, char* path) {
+    r->out        = fopen(path, "wb");
+    if (!r->out) error("[Bench] Cannot open %s\n", path);
+    r->frame_ms   = heap_alloc(sizeof(f64) * frames, ALLOC_DEBUG);
+    r->counters   = heap_alloc(sizeof(RenderCounters) * frames, ALLOC_DEBUG);
+    r->heap_allocations = heap_alloc(sizeof(u64) * frames, ALLOC_DEBUG);
+    r->count      = 0;
+}
+
+void bench_results_add(BenchResults* r, f64 frame_ms, RenderCounters* counters, u64 heap_allocations) {
+    if (r->count == bench_options.frames) return;
+    r->frame_ms[r->count]         = frame_ms;
+    r->counters[r->count]         = *counters;
+    r->heap_allocations[r->count] = heap_allocations;
+    r->count++;
+}
+
+int compare_f64(const void* pa, const void* pb) {
+    f64 a = *(f64*) pa;
+    f64 b = *(f64*) pb;
+    return a < b ? -1 : a > b;
+}
+
+// nearest rank on sorted data
+f64 percentile(f64* sorted, u32 count, f64 p) {
+    return sorted[(u32) (p * (count - 1) + 0.5)];
+}
+
+void write_bench_results(BenchResults* r, char* path) {
+
+    u32             count    = r->count > BENCH_WARMUP ? r->count - BENCH_WARMUP : 0;
+    f64*            ms       = r->frame_ms + BENCH_WARMUP;
+    RenderCounters* counters = r->counters + BENCH_WARMUP;
+    if (!count) error("[Bench] No frames measured\n");
+
+    f64* sorted = heap_alloc(sizeof(f64) * count, ALLOC_DEBUG);
+    memcpy(sorted, ms, sizeof(f64) * count);
+    qsort(sorted, count, sizeof(f64), compare_f64);
+
+    u64 heap_sum = 0;
+    u64 heap_max = 0;
+    for (u32 i = BENCH_WARMUP; i < r->count; i++) {
+        heap_sum += r->heap_allocations[i];
+        if (r->heap_allocations[i] > heap_max) heap_max = r->heap_allocations[i];
+    }
+    HeapStats heap = heap_total();
+
+    // every counter is a u64, so walk them as an array
+    f64 sum = 0;
+    u64 counter_sum[RENDER_COUNTER_COUNT] = {0};
+    u64 counter_max[RENDER_COUNTER_COUNT] = {0};
+    for (u32 i = 0; i < count; i++) {
+        sum += ms[i];
+        u64* c = (u64*) &counters[i];
+        for (u32 j = 0; j < RENDER_COUNTER_COUNT; j++) {
+            counter_sum[j] += c[j];
+            if (c[j] > counter_max[j]) counter_max[j] = c[j];
+        }
+    }
+
+    u64 vertex_bytes = 0;
+    u64 index_bytes  = 0;
+    for (u32 i = 0; i < mesh_pool_count; i++) {
+        vertex_bytes += mesh_pools[i].vertex_count * mesh_pools[i].vertex_size;
+        index_bytes  += mesh_pools[i].index_count  * index_type_size(mesh_pools[i].index_type);
+    }
+
+    FILE* f = r->out;
+
+    fprintf(f, 
+        "{\n"
+        "    \"frames\": %u,\n"
+        "    \"warmup\": %u,\n"
+        "    \"dt\": %f,\n"
+        "    \"camera_path_frames\": %u,\n"
+        "    \"frame_ms\": {\"min\": %f, \"avg\": %f, \"p50\": %f, \"p90\": %f, \"p95\": %f, \"p99\": %f, \"max\": %f},\n"
+        "    \"memory\": {\"temp_highest\": %llu, \"mesh_vertex_bytes\": %llu, \"mesh_index_bytes\": %llu, \"mesh_pools\": %u},\n"
+        "    \"heap\": {\"allocs_per_frame\": {\"avg\": %f, \"max\": %llu}, \"live_bytes\": %llu, \"live_blocks\": %llu},\n"
+        "    \"counters\": {\n",
+        count, BENCH_WARMUP, BENCH_DT, camera_path.count,
+        sorted[0], sum / count, 
+        percentile(sorted, count, 0.50), percentile(sorted, count, 0.90), 
+        percentile(sorted, count, 0.95), percentile(sorted, count, 0.99), sorted[count - 1],
+        runtime.temp_buffer.highest, vertex_bytes, index_bytes, mesh_pool_count,
+        heap_sum / (f64) count, heap_max, heap.live_bytes, heap.live_blocks
+    );
+    for (u32 j = 0; j < RENDER_COUNTER_COUNT; j++) {
+        fprintf(f, "        \"%s\": {\"avg\": %f, \"max\": %llu}%s\n", render_counter_names[j], counter_sum[j] / (f64) count, counter_max[j], j + 1 < RENDER_COUNTER_COUNT ? "," : "");
+    }
+    fprintf(f, "    }\n}\n");
+    fclose(f);
+    
+    logprint("[Bench] %u frames, p50 %fms, p99 %fms, written to %s\n", count, percentile(sorted, count, 0.50), percentile(sorted, count, 0.99), path);
+    heap_free(sorted);
+}
+
+
+
+
+/* ==== Frame Stats ==== */
+
+/*
+    main thread, the real time between frames (not the simulation's dt),
+    a rolling history for the overlay, plus every frame when --frame-csv is set.
+    averages hide stutter, so we show percentiles and count spikes:
+    a frame over FRAME_SPIKE_FACTOR times the rolling average
+*/
+
+#define FRAME_HISTORY      240
+#define FRAME_SPIKE_FACTOR 2
+
+typedef struct {
+    
+    f32 ms[FRAME_HISTORY]; // ring
+    u32 head;              // next write
+    u32 count;
+    f64 sum;               // of the history
+    u64 frames;
     
-    glBindVertexArray(mesh->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    u32 spikes;
+    f64 last_spike_ms;
+    u64 last_spike_frame;
     
-    glUniform4fv(glGetUniformLocation(shader, "color"),    1, (f32*) &color);
-    glUniformMatrix2fv(glGetUniformLocation(shader, "transform"), 1, GL_FALSE, (f32*) &m);
+    f32* all; // only with --frame-csv
+    u64  all_count;
+    u64  all_allocated;
+
+} FrameStats;
+
+typedef struct {
+    f64 min;
+    f64 avg;
+    f64 p50;
+    f64 p95;
+    f64 p99;
+    f64 max;
+} FrameSummary;
+
+FrameStats frame_stats;
+
+void frame_stats_add(FrameStats* s, f64 ms) {
+
+    f64 avg = s->count ? s->sum / s->count : 0;
+    if (s->count >= FRAME_HISTORY / 4 && ms > FRAME_SPIKE_FACTOR * avg) { // wait for a few frames, the first ones are always slow
+        s->spikes++;
+        s->last_spike_ms    = ms;
+        s->last_spike_frame = s->frames;
+    }
+
+    if (s->count == FRAME_HISTORY) s->sum -= s->ms[s->head];
+    else                           s->count++;
     
-    f32 rx = 0; // for newline 
-    for (u64 i = 0; i < s.count; i++) {
-        
-        u8 c = s.data[i];
-        switch (c) {
-            case '\t': {  
-                rx += 4.0;
-                continue;
-            }
-            case '\r': continue;
-            case '\n': { 
-                position.y -= scale.y;
-                rx = 0;
-                continue;
-            } 
+    s->ms[s->head] = ms;
+    s->sum        += s->ms[s->head];
+    s->head        = (s->head + 1) % FRAME_HISTORY;
+    s->frames++;
+
+    if (bench_options.frame_csv) {
+        if (s->all_count == s->all_allocated) {
+            s->all_allocated = s->all_allocated ? s->all_allocated * 2 : 1024 * 4;
+            s->all           = heap_realloc(s->all, sizeof(f32) * s->all_allocated, ALLOC_DEBUG);
         }
+        s->all[s->all_count++] = ms;
+    }
+}
+
+FrameSummary frame_stats_summary(FrameStats* s) {
+
+    if (!s->count) return (FrameSummary) {0};
+
+    f64 sorted[FRAME_HISTORY];
+    for (u32 i = 0; i < s->count; i++) sorted[i] = s->ms[i];
+    qsort(sorted, s->count, sizeof(f64), compare_f64);
+
+    return (FrameSummary) {
+        .min = sorted[0],
+        .avg = s->sum / s->count,
+        .p50 = percentile(sorted, s->count, 0.50),
+        .p95 = percentile(sorted, s->count, 0.95),
+        .p99 = percentile(sorted, s->count, 0.99),
+        .max = sorted[s->count - 1],
+    };
+}
+
+// one bar per frame, oldest on the left, plus a line at target_ms, all in one draw
+void draw_frame_graph(FrameStats* s, Vector2 position, Vector2 size, f64 max_ms, f64 target_ms, Vector4 color) {
+
+    u32 count = s->count + 1;
+    
+    u64 offset;
+    Vector2* v = stream_buffer_map(&stream_vertices, sizeof(Vector2) * 6 * count, sizeof(Vector2), &offset);
+
+    f32 w = size.x / FRAME_HISTORY;
+    u32 first = (s->head + FRAME_HISTORY - s->count) % FRAME_HISTORY;
+    
+    for (u32 i = 0; i < count; i++) {
         
-        Vector2 pos = {position.x + scale.x * rx / window_info.aspect, position.y};
-        rx += 1.0;
+        f32 x0, x1, y0, y1;
+        if (i < s->count) {
+            f32 h = size.y * clamp_f32(s->ms[(first + i) % FRAME_HISTORY] / max_ms, 0, 1);
+            x0 = position.x + w * i;
+            x1 = x0 + w * 0.8;
+            y0 = position.y;
+            y1 = position.y + h;
+        } else {
+            f32 y = position.y + size.y * clamp_f32(target_ms / max_ms, 0, 1);
+            x0 = position.x;
+            x1 = position.x + size.x;
+            y0 = y;
+            y1 = y + 2 / (f32) window_info.height;
+        }
         
-        u32 c_start = mesh->indices[c].start;
-        u32 c_count = mesh->indices[c].count;
-           
-        glUniform2fv(glGetUniformLocation(shader, "position"), 1, (f32*) &pos);
-        glDrawArrays(GL_TRIANGLES, c_start, c_count);
+        Vector2* q = v + i * 6;
+        q[0] = (Vector2) {x0, y0};
+        q[1] = (Vector2) {x1, y0};
+        q[2] = (Vector2) {x1, y1};
+        q[3] = (Vector2) {x0, y0};
+        q[4] = (Vector2) {x1, y1};
+        q[5] = (Vector2) {x0, y1};
     }
+    
+    stream_buffer_unmap(&stream_vertices);
+
+    u32 shader = asset_shaders.rect;
+    glUseProgram(shader);
+    
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    glBindVertexArray(stream_vertices_vao);
+    
+    Vector2 zero = {0, 0};
+    glUniform4fv(uniform_location(shader, uniform_names.color),    1, (f32*) &color);
+    glUniformMatrix2fv(uniform_location(shader, uniform_names.transform), 1, GL_FALSE, (f32*) &M2_IDENTITY);
+    glUniform2fv(uniform_location(shader, uniform_names.position), 1, (f32*) &zero);
+    
+    glDrawArrays(GL_TRIANGLES, offset / sizeof(Vector2), count * 6);
+    count_draw(GL_TRIANGLES, count * 6, 1);
 
     glDisable(GL_BLEND);
     glEnable(GL_DEPTH_TEST);
 }
 
-void draw_mesh_string_shadowed(Vector2 position, Vector2 offset, Vector2 scale, Vector4 fg_color, Vector4 bg_color, String s) {
-    draw_mesh_string(v2_add(position, offset), scale, bg_color, s);
-    draw_mesh_string(position,                 scale, fg_color, s);
-}
+void write_frame_csv(FrameStats* s, char* path) {
 
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        logprint("[Frame] Cannot write %s\n", path);
+        return;
+    }
 
+    fprintf(f, "frame,ms\n");
+    for (u64 i = 0; i < s->all_count; i++) fprintf(f, "%llu,%.4f\n", i, s->all[i]);
+    fclose(f);
+    
+    logprint("[Frame] Wrote %llu frame times to %s\n", s->all_count, path);
+}
 
 
-/* ---- 3D ---- */
 
-void draw_axis_arrow(Vector3 scale, Camera* cam) {
 
-    Mesh* mesh = &geometry_primitives.axis_arrow;
+/* ==== Input Log ==== */
 
-    Vector3 position = v3_add(cam->position, v3_rotate(V3_Y, cam->orientation));
+/*
+    every InputFrame the simulation consumed, so a session can be replayed exactly
 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
-    
-    Matrix4 m = m4_mul(m4_translate(position), m4_scale(scale));
-    glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "projection"), 1, GL_FALSE, (f32*) &cam->projection);
-    glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "view"), 1, GL_FALSE, (f32*) &cam->view);
-    glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "model"), 1, GL_FALSE, (f32*) &m);
+    header:    InputLogHeader, then the Camera at the start (a normal run starts wherever game.pos left it)
+    per frame: u8 flags, f64 dt, u8 keys, then only what the flags say is there:
+               INPUT_LOG_MOUSE  -> f64 dx, f64 dy
+               INPUT_LOG_WINDOW -> s32 height, f32 aspect (only written when they changed)
+               INPUT_LOG_EVENTS -> u8 count, count * (u8 type, f32 value)
     
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(2);
-   
-    glDrawElements(GL_LINES, mesh->index_count, GL_UNSIGNED_INT, NULL);
-    
-    glEnable(GL_DEPTH_TEST);
-    glLineWidth(1);
+    a frame without mouse movement or events is 10 bytes
+*/
+
+#define INPUT_LOG_MAGIC   0x474f4c49 // "ILOG"
+#define INPUT_LOG_VERSION 1
+
+#define INPUT_LOG_MOUSE   (1 << 0)
+#define INPUT_LOG_WINDOW  (1 << 1)
+#define INPUT_LOG_EVENTS  (1 << 2)
+#define INPUT_LOG_CURSOR  (1 << 3) // cursor_visible
+#define INPUT_LOG_DEBUG   (1 << 4) // show_debug_info
+#define INPUT_LOG_QUIT    (1 << 5)
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 camera_size; // sizeof(Camera) when written, the log is only valid for the same build layout
+    u32 frame_count;
+} InputLogHeader;
+
+typedef struct {
+    u8*        data;
+    u64        count;
+    u64        allocated;
+    u64        cursor; // replay read position
+    u32        frames;
+    InputFrame last;   // window fields are only written when they change
+} InputLog;
+
+InputLog input_record; // main thread
+InputLog input_replay; // main thread
+
+void input_log_put(InputLog* log, void* data, u64 size) {
+    if (log->count + size > log->allocated) {
+        while (log->count + size > log->allocated) log->allocated = log->allocated ? log->allocated * 2 : 1024 * 64;
+        log->data = heap_realloc(log->data, log->allocated, ALLOC_DEBUG);
+    }
+    memcpy(log->data + log->count, data, size);
+    log->count += size;
 }
 
-// todo: how to handle other shaders? how to get light?
-void draw_model(Model3D* model, s32 count, Camera* cam) {
-    
-    Mesh* mesh = model->mesh; 
+u8 input_log_get(InputLog* log, void* out, u64 size) {
+    if (log->cursor + size > log->count) return 0;
+    memcpy(out, log->data + log->cursor, size);
+    log->cursor += size;
+    return 1;
+}
 
-    glUseProgram(mesh->id.shader); 
-    glBindVertexArray(mesh->id.vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
-    
-    glBindTexture(GL_TEXTURE_2D, mesh->id.texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(glGetUniformLocation(mesh->id.shader, "texture0"), 0);
-    
-    glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "projection"), 1, GL_FALSE, (f32*) &cam->projection);
-    glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "view"), 1, GL_FALSE, (f32*) &cam->view);
-    glUniform3fv(glGetUniformLocation(mesh->id.shader, "light_pos"), 1, (f32*) &light);
+void input_log_begin(InputLog* log, Camera* start) {
+    InputLogHeader header = {INPUT_LOG_MAGIC, INPUT_LOG_VERSION, sizeof(Camera), 0};
+    input_log_put(log, &header, sizeof(header));
+    input_log_put(log, start,   sizeof(Camera));
+    log->last = (InputFrame) {0};
+}
+
+void input_log_write(InputLog* log, InputFrame* in) {
+
+    u8 flags = 0;
+    if (in->mouse_dx != 0 || in->mouse_dy != 0)                             flags |= INPUT_LOG_MOUSE;
+    if (in->height != log->last.height || in->aspect != log->last.aspect)   flags |= INPUT_LOG_WINDOW;
+    if (in->event_count)                                                    flags |= INPUT_LOG_EVENTS;
+    if (in->cursor_visible)                                                 flags |= INPUT_LOG_CURSOR;
+    if (in->show_debug_info)                                                flags |= INPUT_LOG_DEBUG;
+    if (in->quit)                                                           flags |= INPUT_LOG_QUIT;
+
+    u8 keys = in->keys;
+    input_log_put(log, &flags,   sizeof(flags));
+    input_log_put(log, &in->dt,  sizeof(in->dt));
+    input_log_put(log, &keys,    sizeof(keys));
+
+    if (flags & INPUT_LOG_MOUSE) {
+        input_log_put(log, &in->mouse_dx, sizeof(in->mouse_dx));
+        input_log_put(log, &in->mouse_dy, sizeof(in->mouse_dy));
+    }
+    if (flags & INPUT_LOG_WINDOW) {
+        input_log_put(log, &in->height, sizeof(in->height));
+        input_log_put(log, &in->aspect, sizeof(in->aspect));
+    }
+    if (flags & INPUT_LOG_EVENTS) {
+        u8 count = in->event_count;
+        input_log_put(log, &count, sizeof(count));
+        for (u32 i = 0; i < count; i++) {
+            u8 type = in->events[i].type;
+            input_log_put(log, &type,                 sizeof(type));
+            input_log_put(log, &in->events[i].value,  sizeof(in->events[i].value));
+        }
+    }
+
+    log->last = *in;
+    log->frames++;
+}
+
+// 0 at the end of the log or on a broken frame
+u8 input_log_read(InputLog* log, InputFrame* out) {
+
+    InputFrame in = log->last;
+    in.mouse_dx    = 0;
+    in.mouse_dy    = 0;
+    in.event_count = 0;
     
-    for (s32 i = 0; i < count; i++) {
-        Matrix4 m = entity_to_m4(model[i].base);
-        glUniformMatrix4fv(glGetUniformLocation(mesh->id.shader, "model"), 1, GL_FALSE, (f32*) &m);
-        glDrawElements(cam->draw_mode, mesh->index_count, GL_UNSIGNED_INT, NULL);
+    u8 flags;
+    u8 keys;
+    if (!input_log_get(log, &flags, sizeof(flags))) return 0;
+    if (!input_log_get(log, &in.dt, sizeof(in.dt))) return 0;
+    if (!input_log_get(log, &keys,  sizeof(keys)))  return 0;
+    in.keys = keys;
+
+    if (flags & INPUT_LOG_MOUSE) {
+        if (!input_log_get(log, &in.mouse_dx, sizeof(in.mouse_dx))) return 0;
+        if (!input_log_get(log, &in.mouse_dy, sizeof(in.mouse_dy))) return 0;
     }
+    if (flags & INPUT_LOG_WINDOW) {
+        if (!input_log_get(log, &in.height, sizeof(in.height))) return 0;
+        if (!input_log_get(log, &in.aspect, sizeof(in.aspect))) return 0;
+    }
+    if (flags & INPUT_LOG_EVENTS) {
+        u8 count;
+        if (!input_log_get(log, &count, sizeof(count)) || count > INPUT_MAX_EVENTS) return 0;
+        for (u32 i = 0; i < count; i++) {
+            u8 type;
+            if (!input_log_get(log, &type,                sizeof(type)))                return 0;
+            if (!input_log_get(log, &in.events[i].value,  sizeof(in.events[i].value)))  return 0;
+            in.events[i].type = type;
+        }
+        in.event_count = count;
+    }
+
+    in.cursor_visible  = (flags & INPUT_LOG_CURSOR) != 0;
+    in.show_debug_info = (flags & INPUT_LOG_DEBUG)  != 0;
+    in.quit            = (flags & INPUT_LOG_QUIT)   != 0;
+
+    log->last = in;
+    *out      = in;
+    return 1;
+}
+
+void save_input_log(InputLog* log, char* path) {
+    ((InputLogHeader*) log->data)->frame_count = log->frames;
+    save_file((String) {log->data, log->count}, path);
+    logprint("[Input] Recorded %u frames (%llu bytes) to %s\n", log->frames, log->count, path);
 }
 
+// puts the recorded start camera into cam
+void load_input_log(InputLog* log, char* path, Camera* cam) {
 
+    String file = load_file(path);
+    *log = (InputLog) {.data = file.data, .count = file.count, .allocated = file.count};
 
+    InputLogHeader header;
+    if (!input_log_get(log, &header, sizeof(header)))  error("[Input] %s is too short\n", path);
+    if (header.magic   != INPUT_LOG_MAGIC)              error("[Input] %s is not an input log\n", path);
+    if (header.version != INPUT_LOG_VERSION)            error("[Input] %s has version %u, we read %u\n", path, header.version, INPUT_LOG_VERSION);
+    if (header.camera_size != sizeof(Camera))           error("[Input] %s was recorded by a different build\n", path);
+    if (!input_log_get(log, cam, sizeof(Camera)))       error("[Input] %s is too short\n", path);
+    
+    log->frames = header.frame_count;
+    logprint("[Input] Replaying %u frames from %s\n", log->frames, path);
+}
 
 
 
@@ -679,26 +2419,35 @@ void draw_model(Model3D* model, s32 count, Camera* cam) {
 /* ==== Resource Loading ==== */
 
 // todo: can only handle RGBA now
-Texture load_texture(char* path, s32 channel) {
+Handle(Texture) load_texture(char* path, s32 channel) {
 
-    Texture t; 
-    
-    t.data    = stbi_load(path, &t.w, &t.h, NULL, channel);
-    t.channel = channel;
-    if (!t.data) error("[Texture] Cannot load %s\n", path);
+    profile_begin("load_texture");
 
-    glGenTextures(1, &t.id);
-    glBindTexture(GL_TEXTURE_2D, t.id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t.w, t.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, t.data);
+    Handle(Texture) h = texture_new();
+    Texture*        t = texture_get(h);
+    
+    t->data    = stbi_load(path, &t->w, &t->h, NULL, channel);
+    t->channel = channel;
+    t->name    = intern_c_string(path);
+    if (!t->data) error("[Texture] Cannot load %s\n", path);
+
+    glGenTextures(1, &t->id);
+    glBindTexture(GL_TEXTURE_2D, t->id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t->w, t->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, t->data);
     
     logprint("[Texture] Loaded %s\n", path);
 
-    return t;
+    profile_end();
+    return h;
 }
 
-void unload_texture(Texture* t) {
+// the Texture itself belongs to the pool, handles to it turn stale here
+void unload_texture(Handle(Texture) h) {
+    Texture* t = texture_get(h);
+    if (!t) return;
     stbi_image_free(t->data);
-    free(t);
+    glDeleteTextures(1, &t->id);
+    pool_remove(&textures, h.h);
 }
 
 u32 compile_shader(char* path) {
@@ -717,33 +2466,47 @@ u32 compile_shader(char* path) {
         {"[ctrl]", GL_TESS_CONTROL_SHADER},
     };
 
+    profile_begin("compile_shader");
+
     u32 shader = glCreateProgram();
 
     void* (*old_alloc)(u64) = runtime.alloc;
     runtime.alloc = temp_alloc;
-    char* code = load_file_as_c_string(path);
+    String code = load_file(path);
     runtime.alloc = old_alloc;
  
-    if (!code) return 0;
+    if (!code.data) {
+        profile_end();
+        return 0;
+    }
 
-    char* ps[6];
-    for (s32 i = 0; i < 6; i++) ps[i] = strstr(code, tags[i].tag); // find the tags
+    // a stage runs from the line after its tag to the next tag, or the end, any line ending
+    String found[6];
+    String stages[6] = {0};
+    for (s32 i = 0; i < 6; i++) found[i] = string_find(code, (String) {(u8*) tags[i].tag, strlen(tags[i].tag)});
     for (s32 i = 0; i < 6; i++) {
-        if (ps[i]) {
-            *ps[i] = '\0'; // "cut" the string (works for now, maybe no need to switch to String)
-            ps[i] += 8;    // get string starting point without tag
+        
+        if (!found[i].data) continue;
+        
+        String line_end = string_find(found[i], string("\n"));
+        if (!line_end.data) continue; // a tag on the last line, nothing in it
+        
+        String stage = {line_end.data + 1, line_end.count - 1};
+        for (s32 j = 0; j < 6; j++) {
+            if (found[j].data && found[j].data > stage.data && found[j].data < stage.data + stage.count) stage.count = found[j].data - stage.data;
         }
+        stages[i] = stage;
     }
 
     for (s32 i = 0; i < 6; i++) {
 
-        if (ps[i]) {
+        if (stages[i].data) {
 
-            u32 id = glCreateShader(tags[i].type);
+            u32 id     = glCreateShader(tags[i].type);
+            s32 length = stages[i].count;
             s32 success;
-            s32 length;
 
-            glShaderSource(id, 1, (const char**) &ps[i], NULL);
+            glShaderSource(id, 1, (const char**) &stages[i].data, &length);
             glCompileShader(id);
             glGetShaderiv(id, GL_COMPILE_STATUS, &success);
             glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
@@ -763,8 +2526,13 @@ u32 compile_shader(char* path) {
     glLinkProgram(shader);
     glValidateProgram(shader);
 
+    // GLSL 330 has no layout(binding), so hook up the shared blocks here
+    u32 frame_block = glGetUniformBlockIndex(shader, "Frame");
+    if (frame_block != GL_INVALID_INDEX) glUniformBlockBinding(shader, frame_block, FRAME_UNIFORM_BINDING);
+
     logprint("[GLSL] Compiled %s\n", path);
 
+    profile_end();
     return shader;
 }
 
@@ -800,6 +2568,37 @@ void load_position(Camera* cam) {
     logprint("[Save] [Warning] Cannot Load position, use default.\n");
 }
 
+// for data that never changes after upload, immutable storage when we have it (GL 4.4), a static hint otherwise
+void upload_static_buffer(u32 target, u64 size, void* data) {
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) glBufferStorage(target, size, data, 0);
+    else                                                   glBufferData(target, size, data, GL_STATIC_DRAW);
+}
+
+// same, but filled piece by piece with glBufferSubData
+void allocate_static_buffer(u32 target, u64 size) {
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) glBufferStorage(target, size, NULL, GL_DYNAMIC_STORAGE_BIT);
+    else                                                   glBufferData(target, size, NULL, GL_STATIC_DRAW);
+}
+
+// narrow u32 indices into temp memory, returns the input as is for GL_UNSIGNED_INT
+void* pack_indices(u32* indices, u32 count, u32 type) {
+
+    switch (type) {
+        case GL_UNSIGNED_BYTE: {
+            u8* out = temp_alloc(count);
+            for (u32 i = 0; i < count; i++) out[i] = indices[i];
+            return out;
+        }
+        case GL_UNSIGNED_SHORT: {
+            u16* out = temp_alloc(sizeof(u16) * count);
+            for (u32 i = 0; i < count; i++) out[i] = indices[i];
+            return out;
+        }
+    }
+
+    return indices;
+}
+
 // todo: further cleanup, handle sprites not in ASCII range, move this to GPU?
 void fill_mesh_alphabet(MeshAlphabet* mesh, Texture* tex, s32 char_w, s32 char_h) {
 
@@ -816,7 +2615,7 @@ void fill_mesh_alphabet(MeshAlphabet* mesh, Texture* tex, s32 char_w, s32 char_h
 
         w = tex->w;
         h = tex->h;
-        data = malloc(w * h); 
+        data = heap_alloc(w * h, ALLOC_MESH); 
 
         u64 acc = 0;
         for (s32 i = h - 1; i >= 0; i--) {
@@ -849,7 +2648,7 @@ void fill_mesh_alphabet(MeshAlphabet* mesh, Texture* tex, s32 char_w, s32 char_h
         total_vertex_count  += vertex_count;
     }
    
-    Vector2* vertices = malloc(sizeof(Vector2) * total_vertex_count);
+    Vector2* vertices = heap_alloc(sizeof(Vector2) * total_vertex_count, ALLOC_MESH);
     
     u64 acc = 0;
     for (u8 c = ' '; c <= '~'; c++) {
@@ -899,7 +2698,7 @@ void fill_mesh_alphabet(MeshAlphabet* mesh, Texture* tex, s32 char_w, s32 char_h
         }
     }
     
-    free(data);
+    heap_free(data);
 
     u32 shader = asset_shaders.rect;
     glUseProgram(shader); 
@@ -909,75 +2708,444 @@ void fill_mesh_alphabet(MeshAlphabet* mesh, Texture* tex, s32 char_w, s32 char_h
     glGenVertexArrays(1, &vao);
     
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2) * total_vertex_count, (f32*) vertices, GL_DYNAMIC_DRAW);
+    upload_static_buffer(GL_ARRAY_BUFFER, sizeof(Vector2) * total_vertex_count, vertices);
 
     glBindVertexArray(vao);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(f32), (void*) 0);
     glEnableVertexAttribArray(0);
 
-    mesh->vertices = vertices;
-    mesh->vao      = vao;
-    mesh->vbo      = vbo;
+    mesh->vertices = vertices;
+    mesh->vao      = vao;
+    mesh->vbo      = vbo;
+}
+
+// finds or makes the pool for this vertex layout, storage is immutable but writable with glBufferSubData
+MeshPool* get_mesh_pool(u32* vertex_structure, u32 vertex_structure_count, u64 vertex_size, u32 index_type) {
+
+    assert(vertex_structure_count <= MESH_POOL_MAX_ATTRIBUTES);
+
+    for (u32 i = 0; i < mesh_pool_count; i++) {
+        MeshPool* p = &mesh_pools[i];
+        if (p->vertex_size            != vertex_size)            continue;
+        if (p->index_type             != index_type)             continue;
+        if (p->vertex_structure_count != vertex_structure_count) continue;
+        if (memcmp(p->vertex_structure, vertex_structure, sizeof(u32) * vertex_structure_count)) continue;
+        return p;
+    }
+
+    if (mesh_pool_count == MESH_POOL_MAX_COUNT) error("[Mesh] Too many vertex layouts, raise MESH_POOL_MAX_COUNT\n");
+
+    MeshPool* p = &mesh_pools[mesh_pool_count++];
+    *p = (MeshPool) {
+        .vertex_structure_count = vertex_structure_count,
+        .vertex_size            = vertex_size,
+        .index_type             = index_type,
+        .vertex_capacity        = MESH_POOL_VERTEX_BYTES / vertex_size,
+        .index_capacity         = MESH_POOL_INDEX_BYTES  / index_type_size(index_type),
+    };
+    memcpy(p->vertex_structure, vertex_structure, sizeof(u32) * vertex_structure_count);
+
+    glGenVertexArrays(1, &p->id.vertex_array);
+    glGenBuffers(     1, &p->id.vertices);
+    glGenBuffers(     1, &p->id.indices);
+
+    glBindVertexArray(p->id.vertex_array);
+
+    glBindBuffer(GL_ARRAY_BUFFER, p->id.vertices);
+    allocate_static_buffer(GL_ARRAY_BUFFER, p->vertex_capacity * vertex_size);
+
+    u64 offset = 0;
+    for (u32 i = 0; i < vertex_structure_count; i++) {
+        u32 a = vertex_structure[i];
+        glVertexAttribPointer(i, vertex_attribute_components(a), vertex_attribute_gl_type(a), vertex_attribute_normalized(a), vertex_size, (void*) offset);
+        glEnableVertexAttribArray(i);
+        offset += vertex_attribute_size(a);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, stream_instances.id);
+    for (u32 i = 0; i < 4; i++) {
+        u32 location = MODEL_MATRIX_LOCATION + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4), (void*) (i * sizeof(Vector4)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->id.indices);
+    allocate_static_buffer(GL_ELEMENT_ARRAY_BUFFER, p->index_capacity * index_type_size(index_type));
+
+    logprint("[Mesh] New pool: %u attributes, %llu bytes per vertex\n", vertex_structure_count, vertex_size);
+
+    return p;
+}
+
+u32* copy_indices(u32* indices, u32 count) {
+    u32* out = heap_alloc(sizeof(u32) * count, ALLOC_MESH);
+    memcpy(out, indices, sizeof(u32) * count);
+    return out;
+}
+
+// copies one index range and its vertices to the end of the pool
+MeshLOD mesh_pool_append(MeshPool* pool, f32* vertices, u32 vertex_count, u32* indices, u32 index_count) {
+
+    if (pool->vertex_count + vertex_count > pool->vertex_capacity || pool->index_count + index_count > pool->index_capacity) {
+        error("[Mesh] Pool full (vertex size %llu), raise MESH_POOL_VERTEX_BYTES or MESH_POOL_INDEX_BYTES\n", pool->vertex_size);
+    }
+
+    MeshLOD l = {
+        .first_index = pool->index_count,
+        .index_count = index_count,
+        .base_vertex = pool->vertex_count,
+    };
+
+    glBindVertexArray(pool->id.vertex_array);
+
+    glBindBuffer(GL_ARRAY_BUFFER, pool->id.vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, pool->vertex_count * pool->vertex_size, vertex_count * pool->vertex_size, vertices);
+
+    {
+        u64   index_size = index_type_size(pool->index_type);
+        u64   size       = index_count * index_size;
+        void* data       = pack_indices(indices, index_count, pool->index_type);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, pool->index_count * index_size, size, data);
+        if (data != indices) temp_free(size);
+    }
+
+    pool->vertex_count += vertex_count;
+    pool->index_count  += index_count;
+
+    return l;
+}
+
+// all meshes made here are static, stream per-frame data through a StreamBuffer instead
+#define make_mesh_from_stack_data(mesh, v, i, va, Vertex_Type, shader, texture) make_mesh(mesh, (f32*) v, i, va, length_of(v), length_of(i), length_of(va), sizeof(Vertex_Type), shader, texture, 1)
+#define make_packed_mesh_from_stack_data(mesh, v, i, va, packed, shader, texture) make_mesh(mesh, pack_vertices((f32*) v, length_of(v), va, packed, length_of(va)), copy_indices(i, length_of(i)), packed, length_of(v), length_of(i), length_of(va), vertex_structure_size(packed, length_of(packed)), shader, texture, 0)
+void make_mesh(
+    Mesh* mesh, 
+    f32*  vertices, 
+    u32*  indices, 
+    u32*  vertex_structure,
+    u32   vertex_count, 
+    u32   index_count,
+    u32   vertex_structure_count,
+    u64   vertex_size, 
+    u32   shader,
+    u32   texture,
+    u8    is_stack_data
+) {
+    
+    if (is_stack_data) {
+        mesh->vertex_data = heap_alloc(vertex_size * vertex_count, ALLOC_MESH);
+        mesh->indices     = heap_alloc(sizeof(u32) * index_count, ALLOC_MESH);
+    } else {
+        mesh->vertex_data = vertices;
+        mesh->indices     = indices;
+    }
+   
+    mesh->vertex_data_count = vertex_count * vertex_size / sizeof(f32);
+    mesh->index_count       = index_count;  
+    mesh->index_type        = index_type_for(vertex_count);
+    
+    if (is_stack_data) {
+        memcpy(mesh->vertex_data, vertices, vertex_size * vertex_count); 
+        memcpy(mesh->indices,     indices,  sizeof(u32) * index_count); 
+    }
+    
+    // first attribute is the position, 2D meshes get a flat box
+    {
+        u32  a          = vertex_structure_count ? vertex_structure[0] : 0;
+        u32  components = a & VERTEX_COUNT_MASK;
+        AABB b          = vertex_count ? AABB_EMPTY : (AABB) {0};
+        for (u32 i = 0; i < vertex_count && components >= 2; i++) {
+            Vector4 v = vertex_attribute_read((u8*) mesh->vertex_data + i * vertex_size, a);
+            b = aabb_add_point(b, (Vector3) {v.x, v.y, components >= 3 ? v.z : 0});
+        }
+        mesh->bounds = b;
+    }
+
+    mesh->id.shader  = shader;
+    mesh->id.texture = texture;
+
+    MeshPool* pool = get_mesh_pool(vertex_structure, vertex_structure_count, vertex_size, mesh->index_type);
+
+    mesh->pool            = pool - mesh_pools;
+    mesh->id.vertex_array = pool->id.vertex_array;
+    mesh->id.vertices     = pool->id.vertices;
+    mesh->id.indices      = pool->id.indices;
+    mesh->lods[0]         = mesh_pool_append(pool, mesh->vertex_data, vertex_count, mesh->indices, index_count);
+    mesh->lod_count       = 1;
+}
+
+// appends a coarser level after the existing ones, same vertex structure, the data is not kept
+void add_mesh_lod(Mesh* mesh, f32* vertices, u32* indices, u32 vertex_count, u32 index_count, f32 error) {
+    assert(mesh->lod_count < MESH_MAX_LODS);
+    MeshLOD l = mesh_pool_append(&mesh_pools[mesh->pool], vertices, vertex_count, indices, index_count);
+    l.error = error;
+    mesh->lods[mesh->lod_count++] = l;
+}
+
+// the whole chain from one generator, levels are contiguous in the pool as long as nothing else is made in between,
+// level 0 becomes the mesh and keeps its data, triangle lists get optimized before packing
+void make_mesh_lod_chain(
+    Mesh*    mesh,
+    MeshData (*generate)(u32 edges),
+    u32*     edges,
+    u32      level_count,
+    u32*     generated_structure, // plain f32 counts, what the generator writes
+    u32*     packed_structure,    // what goes to the GPU, NULL to keep the floats
+    u32      vertex_structure_count,
+    u32      shader,
+    u32      texture,
+    char*    optimize_name // NULL for line meshes
+) {
+
+    assert(level_count && level_count <= MESH_MAX_LODS);
+
+    u32* vertex_structure = packed_structure ? packed_structure : generated_structure;
+    u64  generated_size   = vertex_structure_size(generated_structure, vertex_structure_count);
+    u64  vertex_size      = vertex_structure_size(vertex_structure,    vertex_structure_count);
+
+    for (u32 i = 0; i < level_count; i++) {
+        
+        MeshData d = generate(edges[i]);
+        if (optimize_name) optimize_mesh(optimize_name, d.vertices, d.indices, d.vertex_count, d.index_count, generated_size, 1);
+
+        if (packed_structure) {
+            f32* packed = pack_vertices(d.vertices, d.vertex_count, generated_structure, packed_structure, vertex_structure_count);
+            heap_free(d.vertices);
+            d.vertices = packed;
+        }
+        
+        // polygon with n edges is off by 1 - cos(pi / n) of the radius in the middle of an edge
+        f32 error = 1 - cosf(TAU / 2 / edges[i]);
+
+        if (i == 0) {
+            make_mesh(
+                mesh, 
+                d.vertices,   d.indices,     vertex_structure,
+                d.vertex_count, d.index_count, vertex_structure_count,
+                vertex_size, shader, texture, 0
+            );
+            mesh->lods[0].error = error;
+        } else {
+            add_mesh_lod(mesh, d.vertices, d.indices, d.vertex_count, d.index_count, error);
+            heap_free(d.vertices);
+            heap_free(d.indices);
+        }
+    }
+}
+
+
+
+
+/* ==== Geometry Generators ==== */
+
+// unit circle outline, line list
+MeshData generate_ring(u32 edges) {
+
+    typedef struct {
+        Vector2 pos;
+    } Vertex;
+
+    u32 vertex_count = edges;
+    u32 index_count  = edges * 2;
+    Vertex* vertices = heap_alloc(sizeof(Vertex) * vertex_count, ALLOC_MESH); 
+    u32*    indices  = heap_alloc(sizeof(u32)    * index_count, ALLOC_MESH); 
+
+    for (u32 i = 0; i < vertex_count; i++) {
+        f32 rad  = TAU * i / (f32) edges;
+        vertices[i].pos = (Vector2) {cosf(rad), sinf(rad)};
+    }
+
+    for (u32 i = 0; i < edges - 1; i++) {
+        indices[i * 2 + 0] = i;
+        indices[i * 2 + 1] = i + 1;
+    }
+    indices[index_count - 2] = edges - 1;
+    indices[index_count - 1] = 0;
+
+    return (MeshData) {(f32*) vertices, indices, vertex_count, index_count};
+}
+
+// unit disc, triangle fan around the center as a triangle list
+MeshData generate_circle(u32 edges) {
+
+    typedef struct {
+        Vector2 pos;
+    } Vertex;
+    
+    u32 vertex_count = edges + 1;
+    u32 index_count  = edges * 3;
+
+    Vertex* vertices = heap_alloc(sizeof(Vertex) * vertex_count, ALLOC_MESH); 
+    u32*    indices  = heap_alloc(sizeof(u32)    * index_count, ALLOC_MESH);
+
+    for (u32 i = 1; i < vertex_count; i++) {
+        f32 rad = TAU * i / (f32) edges;
+        vertices[i].pos = (Vector2) {cosf(rad), sinf(rad)};
+    }
+    
+    for (u32 j = 0; j < edges; j++) {
+        indices[j * 3 + 0] = 0;
+        indices[j * 3 + 1] = j + 1;
+        indices[j * 3 + 2] = j + 2;
+    }
+    
+    vertices[0].pos = (Vector2) {0, 0};
+    indices[edges * 3 - 1] = 1;
+
+    return (MeshData) {(f32*) vertices, indices, vertex_count, index_count};
 }
 
-#define make_mesh_from_stack_data(mesh, v, i, va, Vertex_Type, shader, texture) make_mesh(mesh, (f32*) v, i, va, length_of(v), length_of(i), length_of(va), sizeof(Vertex_Type), shader, texture, 1)
-void make_mesh(
-    Mesh* mesh, 
-    f32*  vertices, 
-    u32*  indices, 
-    u32*  vertex_structure,
-    u32   vertex_count, 
-    u32   index_count,
-    u32   vertex_structure_count,
-    u64   vertex_size, 
-    u32   shader,
-    u32   texture,
-    u8    is_stack_data
-) {
+// unit UV sphere, edges around the equator, edges / 2 from pole to pole, edges must be even and >= 6
+MeshData generate_sphere(u32 edges) {
     
-    if (is_stack_data) {
-        mesh->vertex_data = malloc(vertex_size * vertex_count);
-        mesh->indices     = malloc(sizeof(u32) * index_count);
-    } else {
-        mesh->vertex_data = vertices;
-        mesh->indices     = indices;
-    }
+    typedef struct {
+        Vector3 pos;
+        Vector2 uv;
+        Vector3 normal; // todo: not done
+    } Vertex;
+
+    assert(edges >= 6 && edges % 2 == 0);
    
-    mesh->vertex_data_count = vertex_count * vertex_size / sizeof(f32);
-    mesh->index_count       = index_count;  
+    u32 vertex_count = (edges / 2 - 1) * edges + 2;
+    u32 index_count  = 2 * edges * 3 + (edges / 2 - 2) * edges * 3 * 2;
+
+    Vertex* vertices = heap_alloc(sizeof(Vertex) * vertex_count, ALLOC_MESH); 
+    u32*    indices  = heap_alloc(sizeof(u32)    * index_count, ALLOC_MESH);
     
-    if (is_stack_data) {
-        memcpy(mesh->vertex_data, vertices, vertex_size * vertex_count); 
-        memcpy(mesh->indices,     indices,  sizeof(u32) * index_count); 
+    // fill vertices
+    for (u32 i = 1; i < edges / 2; i++) {
+        
+        f32 r1 = TAU * (0.25 - i / (f32) edges);
+        
+        for (u32 j = 0; j < edges; j++) {
+            
+            f32 r2 = TAU * j / (f32) edges;
+            
+            f32 cr1 = cosf(r1);
+            f32 sr1 = sinf(r1);
+            f32 cr2 = cosf(r2);
+            f32 sr2 = sinf(r2);
+            
+            // final sphere angle output 
+            f32 cs  = cr2 * cr1;
+            f32 ss  = sr2 * cr1;
+            
+            // uv
+            f32 cuv = cs * 0.5 + 0.5;
+            f32 suv = ss * 0.5 + 0.5;
+
+            u32 pos = 1 + (i - 1) * edges + j;
+            vertices[pos] = (Vertex) {{cs, ss, sr1}, {cuv, suv}, {1, 1, 1}};
+        }
     }
+
+    vertices[0               ] = (Vertex) {{0, 0,  1}, {0.5, 0.5}, {1, 1, 1}};
+    vertices[vertex_count - 1] = (Vertex) {{0, 0, -1}, {0.5, 0.5}, {1, 1, 1}};
+   
+
+    u32 acc = 0;
     
-    mesh->id.shader  = shader;
-    mesh->id.texture = texture;
+    // top cap
+    for (u32 i = 1; i < edges; i++) {
+        u32 i0 = 0;
+        u32 i1 = i;
+        u32 i2 = i + 1;
+        indices[acc + 0] = i0;
+        indices[acc + 1] = i1;
+        indices[acc + 2] = i2;
+        acc += 3;
+    }
+    {
+        // loop back
+        u32 i0 = 0;
+        u32 i1 = edges;
+        u32 i2 = 1;
+        indices[acc + 0] = i0;
+        indices[acc + 1] = i1;
+        indices[acc + 2] = i2;
+        acc += 3;
+    }
+   
 
-    glGenVertexArrays(1, &mesh->id.vertex_array);
-    glGenBuffers(     1, &mesh->id.vertices);
-    glGenBuffers(     1, &mesh->id.indices);
+    // middle strips
+    for (u32 i = 1; i < edges / 2 - 1; i++) {
+        u32 up   = (i - 1) * edges + 1;
+        u32 down = (i) * edges + 1;
+        for (u32 j = 0; j < edges - 1; j++) {
+            u32 i0 = up   + j;
+            u32 i1 = down + j;
+            u32 i2 = up   + j + 1;
+            u32 i3 = down + j + 1;
+            indices[acc + 0] = i0;
+            indices[acc + 1] = i1;
+            indices[acc + 2] = i3;
 
-    glUseProgram(mesh->id.shader);
+            indices[acc + 3] = i0;
+            indices[acc + 4] = i3;
+            indices[acc + 5] = i2;
+            acc += 6;
+        }
+        {
+            // loop back
+            u32 j = edges - 1;
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->id.vertices);
-    glBufferData(GL_ARRAY_BUFFER, mesh->vertex_data_count * sizeof(f32), mesh->vertex_data, GL_DYNAMIC_DRAW);
+            u32 i0 = up   + j;
+            u32 i1 = down + j;
+            u32 i2 = up;
+            u32 i3 = down;
+            indices[acc + 0] = i0;
+            indices[acc + 1] = i1;
+            indices[acc + 2] = i3;
 
-    glBindVertexArray(mesh->id.vertex_array);
+            indices[acc + 3] = i0;
+            indices[acc + 4] = i3;
+            indices[acc + 5] = i2;
+            acc += 6;
+        }
+    }
     
-    u32 step = 0;
-    for (u32 i = 0; i < vertex_structure_count; i++) {
-        glVertexAttribPointer(i, vertex_structure[i], GL_FLOAT, GL_FALSE, vertex_size, (void*) (step * sizeof(f32)));
-        glEnableVertexAttribArray(i);
-        step += vertex_structure[i];
+    // bottom cap
+    for (u32 i = edges * (edges / 2 - 2) + 1; i < vertex_count - 2; i++) {
+        u32 i0 = vertex_count - 1;
+        u32 i1 = i;
+        u32 i2 = i + 1;
+        indices[acc + 0] = i0;
+        indices[acc + 1] = i2;
+        indices[acc + 2] = i1;
+        acc += 3;
+    }
+    {
+        // loop back
+        u32 i = edges * (edges / 2 - 2) + 1;
+        u32 i0 = vertex_count - 1;
+        u32 i1 = vertex_count - 2;
+        u32 i2 = i;
+        indices[acc + 0] = i0;
+        indices[acc + 1] = i2;
+        indices[acc + 2] = i1;
+        acc += 3;
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->id.indices);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->index_count * sizeof(u32), mesh->indices, GL_DYNAMIC_DRAW);
+    return (MeshData) {(f32*) vertices, indices, vertex_count, index_count};
 }
 
 void make_geometry_primitives() {
 
+    GeometryPrimitives* gp = &geometry_primitives;
+    gp->axis_arrow     = mesh_new();
+    gp->ring           = mesh_new();
+    gp->circle         = mesh_new();
+    gp->rectangle      = mesh_new();
+    gp->font_rectangle = mesh_new();
+    gp->cube           = mesh_new();
+    gp->sphere         = mesh_new();
+    gp->tetrahedron    = mesh_new();
+
+    // 16 bytes instead of 32 for pos, uv, normal: position w is padding to keep the uv 4 byte aligned,
+    // positions of the primitives are all inside [-1, 1] so no extra scale is needed
+    u32 packed_3d[] = {4 | VERTEX_SNORM16, 2 | VERTEX_F16, 3 | VERTEX_SNORM10};
+
 
     /* ---- Geometry Primitives ---- */
     /* 
@@ -1021,79 +3189,32 @@ void make_geometry_primitives() {
             0, 3,
         };
 
-        make_mesh_from_stack_data(&geometry_primitives.axis_arrow, v, i, va, Vertex, asset_shaders.axis, 0);
+        make_mesh_from_stack_data(mesh_get(gp->axis_arrow), v, i, va, Vertex, asset_shaders.axis, 0);
     }
     
     // Ring
     {
-        typedef struct {
-            Vector2 pos;
-        } Vertex;
-        
         u32 vertex_structure[] = {2};
+        u32 packed[]           = {2 | VERTEX_SNORM16};
+        u32 edges[]            = {36, 18, 12, 8};
 
-        const u32 edges   = 36;
-        
-        u32 vertex_count = edges;
-        u32 index_count  = edges * 2;
-        Vertex* vertices = malloc(sizeof(Vertex) * vertex_count); 
-        u32*    indices  = malloc(sizeof(u32)    * index_count); 
-
-        for (u32 i = 0; i < vertex_count; i++) {
-            f32 rad  = TAU * i / (f32) edges;
-            vertices[i].pos = (Vector2) {cosf(rad), sinf(rad)};
-        }
-
-        for (u32 i = 0; i < edges - 1; i++) {
-            indices[i * 2 + 0] = i;
-            indices[i * 2 + 1] = i + 1;
-        }
-        indices[70] = 35;
-        indices[71] = 0;
-
-        make_mesh(
-            &geometry_primitives.ring,
-            (f32*) vertices, indices,     vertex_structure,
-            vertex_count,    index_count, length_of(vertex_structure), 
-            sizeof(Vertex), asset_shaders.rect, 0, 0
+        make_mesh_lod_chain(
+            mesh_get(gp->ring), generate_ring, edges, length_of(edges),
+            vertex_structure, packed, length_of(vertex_structure),
+            asset_shaders.rect, 0, NULL
         );
     }
 
     // Circle 2D
     {
-        typedef struct {
-            Vector2 pos;
-        } Vertex;
-        
         u32 vertex_structure[] = {2};
-        
-        const u32 edges = 36;
-
-        u32 vertex_count = edges + 1;
-        u32 index_count  = edges * 3;
-
-        Vertex* vertices = malloc(sizeof(Vertex) * vertex_count); 
-        u32*    indices  = malloc(sizeof(u32)    * index_count);
+        u32 packed[]           = {2 | VERTEX_SNORM16};
+        u32 edges[]            = {36, 18, 12, 8};
 
-        for (u32 i = 1; i < vertex_count; i++) {
-            f32 rad = TAU * i / (f32) edges;
-            vertices[i].pos = (Vector2) {cosf(rad), sinf(rad)};
-        }
-        
-        for (u32 j = 0; j < edges; j++) {
-            indices[j * 3 + 0] = 0;
-            indices[j * 3 + 1] = j + 1;
-            indices[j * 3 + 2] = j + 2;
-        }
-        
-        vertices[0].pos = (Vector2) {0, 0};
-        indices[edges * 3 - 1] = 1;
-
-        make_mesh(
-            &geometry_primitives.circle,
-            (f32*) vertices, indices,     vertex_structure,
-            vertex_count,    index_count, length_of(vertex_structure), 
-            sizeof(Vertex), asset_shaders.rect, 0, 0
+        make_mesh_lod_chain(
+            mesh_get(gp->circle), generate_circle, edges, length_of(edges),
+            vertex_structure, packed, length_of(vertex_structure),
+            asset_shaders.rect, 0, NULL
         );
     }
 
@@ -1119,7 +3240,7 @@ void make_geometry_primitives() {
             0, 2, 3
         };
 
-        make_mesh_from_stack_data(&geometry_primitives.rectangle, v, i, va, Vertex, asset_shaders.rect, 0);
+        make_mesh_from_stack_data(mesh_get(gp->rectangle), v, i, va, Vertex, asset_shaders.rect, 0);
     }
     
     // Mono Font
@@ -1145,7 +3266,7 @@ void make_geometry_primitives() {
             0, 2, 3
         };
 
-        make_mesh_from_stack_data(&geometry_primitives.font_rectangle, v, i, va, Vertex, asset_shaders.font, 0);
+        make_mesh_from_stack_data(mesh_get(gp->font_rectangle), v, i, va, Vertex, asset_shaders.font, 0);
     }
    
     // Cube 
@@ -1180,7 +3301,8 @@ void make_geometry_primitives() {
             3, 0, 4, 3, 4, 7,
         };
 
-        make_mesh_from_stack_data(&geometry_primitives.cube, v, i, va, Vertex, asset_shaders.cube, asset_textures.wood.id);
+        optimize_mesh("cube", (f32*) v, i, length_of(v), length_of(i), sizeof(Vertex), 1);
+        make_packed_mesh_from_stack_data(mesh_get(gp->cube), v, i, va, packed_3d, asset_shaders.cube, texture_get(asset_textures.wood)->id);
     }
     
     // Tetrahedron
@@ -1210,146 +3332,19 @@ void make_geometry_primitives() {
             2, 0, 3,
         };
         
-        make_mesh_from_stack_data(&geometry_primitives.tetrahedron, v, i, va, Vertex, asset_shaders.cube, asset_textures.test.id);
+        optimize_mesh("tetrahedron", (f32*) v, i, length_of(v), length_of(i), sizeof(Vertex), 1);
+        make_packed_mesh_from_stack_data(mesh_get(gp->tetrahedron), v, i, va, packed_3d, asset_shaders.cube, texture_get(asset_textures.test)->id);
     }
     
     // Sphere 
     {
-        typedef struct {
-            Vector3 pos;
-            Vector2 uv;
-            Vector3 normal; // todo: not done
-        } Vertex;
-        
         u32 vertex_structure[] = {3, 2, 3};
-        
-        const u32 edges = 36;
-       
-        u32 vertex_count = (edges / 2 - 1) * edges + 2;
-        u32 index_count  = 2 * edges * 3 + (edges / 2 - 2) * edges * 3 * 2;
-
-        Vertex* vertices = malloc(sizeof(Vertex) * vertex_count); 
-        u32*    indices  = malloc(sizeof(u32)    * index_count);
-        
-        // fill vertices
-        for (u32 i = 1; i < edges / 2; i++) {
-            
-            f32 r1 = TAU * (0.25 - i / (f32) edges);
-            
-            for (u32 j = 0; j < edges; j++) {
-                
-                f32 r2 = TAU * j / (f32) edges;
-                
-                f32 cr1 = cosf(r1);
-                f32 sr1 = sinf(r1);
-                f32 cr2 = cosf(r2);
-                f32 sr2 = sinf(r2);
-                
-                // final sphere angle output 
-                f32 cs  = cr2 * cr1;
-                f32 ss  = sr2 * cr1;
-                
-                // uv
-                f32 cuv = cs * 0.5 + 0.5;
-                f32 suv = ss * 0.5 + 0.5;
-
-                u32 pos = 1 + (i - 1) * edges + j;
-                vertices[pos] = (Vertex) {{cs, ss, sr1}, {cuv, suv}, {1, 1, 1}};
-            }
-        }
+        u32 edges[]            = {36, 18, 12, 8};
 
-        vertices[0               ] = (Vertex) {{0, 0,  1}, {0.5, 0.5}, {1, 1, 1}};
-        vertices[vertex_count - 1] = (Vertex) {{0, 0, -1}, {0.5, 0.5}, {1, 1, 1}};
-       
-
-        u32 acc = 0;
-        
-        // top cap
-        for (u32 i = 1; i < edges; i++) {
-            u32 i0 = 0;
-            u32 i1 = i;
-            u32 i2 = i + 1;
-            indices[acc + 0] = i0;
-            indices[acc + 1] = i1;
-            indices[acc + 2] = i2;
-            acc += 3;
-        }
-        {
-            // loop back
-            u32 i0 = 0;
-            u32 i1 = edges;
-            u32 i2 = 1;
-            indices[acc + 0] = i0;
-            indices[acc + 1] = i1;
-            indices[acc + 2] = i2;
-            acc += 3;
-        }
-       
-
-        // middle strips
-        for (u32 i = 1; i < edges / 2 - 1; i++) {
-            u32 up   = (i - 1) * edges + 1;
-            u32 down = (i) * edges + 1;
-            for (u32 j = 0; j < edges - 1; j++) {
-                u32 i0 = up   + j;
-                u32 i1 = down + j;
-                u32 i2 = up   + j + 1;
-                u32 i3 = down + j + 1;
-                indices[acc + 0] = i0;
-                indices[acc + 1] = i1;
-                indices[acc + 2] = i3;
-
-                indices[acc + 3] = i0;
-                indices[acc + 4] = i3;
-                indices[acc + 5] = i2;
-                acc += 6;
-            }
-            {
-                // loop back
-                u32 j = edges - 1;
-
-                u32 i0 = up   + j;
-                u32 i1 = down + j;
-                u32 i2 = up;
-                u32 i3 = down;
-                indices[acc + 0] = i0;
-                indices[acc + 1] = i1;
-                indices[acc + 2] = i3;
-
-                indices[acc + 3] = i0;
-                indices[acc + 4] = i3;
-                indices[acc + 5] = i2;
-                acc += 6;
-            }
-        }
-        
-        // bottom cap
-        for (u32 i = edges * (edges / 2 - 2) + 1; i < vertex_count - 2; i++) {
-            u32 i0 = vertex_count - 1;
-            u32 i1 = i;
-            u32 i2 = i + 1;
-            indices[acc + 0] = i0;
-            indices[acc + 1] = i2;
-            indices[acc + 2] = i1;
-            acc += 3;
-        }
-        {
-            // loop back
-            u32 i = edges * (edges / 2 - 2) + 1;
-            u32 i0 = vertex_count - 1;
-            u32 i1 = vertex_count - 2;
-            u32 i2 = i;
-            indices[acc + 0] = i0;
-            indices[acc + 1] = i2;
-            indices[acc + 2] = i1;
-            acc += 3;
-        }
-        
-        make_mesh(
-            &geometry_primitives.sphere,
-            (f32*) vertices, indices,     vertex_structure,
-            vertex_count,    index_count, length_of(vertex_structure), 
-            sizeof(Vertex), asset_shaders.cube, asset_textures.wood.id, 0
+        make_mesh_lod_chain(
+            mesh_get(gp->sphere), generate_sphere, edges, length_of(edges),
+            vertex_structure, packed_3d, length_of(vertex_structure),
+            asset_shaders.cube, texture_get(asset_textures.wood)->id, "sphere"
         );
     }
 }
@@ -1360,6 +3355,65 @@ void make_geometry_primitives() {
 
 /* ==== Input ==== */
 
+void push_input_event(u32 type, f32 value) {
+    InputFrame* in = &pending_input;
+    if (in->event_count == INPUT_MAX_EVENTS) return; // only if nobody gathers input for a long time
+    in->events[in->event_count++] = (InputEvent) {type, value};
+}
+
+// main thread, after glfwPollEvents()
+InputFrame gather_input(f64 dt) {
+
+    WindowInfo* w = &window_info;
+
+    InputFrame in = pending_input;
+    pending_input.event_count = 0;
+
+    in.dt              = dt;
+    in.height          = w->height;
+    in.aspect          = w->aspect;
+    in.cursor_visible  = w->cursor_visible;
+    in.show_debug_info = w->show_debug_info;
+    in.quit            = glfwWindowShouldClose(w->handle);
+
+    {
+        f64 mx, my;
+        glfwGetCursorPos(w->handle, &mx, &my);
+        in.mouse_dx = mx - w->cursor.x;
+        in.mouse_dy = my - w->cursor.y;
+        w->cursor.x = mx;
+        w->cursor.y = my;
+    }
+
+    // ehh... is there a better solution? the first delta is from wherever the cursor was before the window
+    if (!w->cursor_visible && w->is_first_frame) {
+        w->is_first_frame = 0;
+        in.mouse_dx = 0;
+        in.mouse_dy = 0;
+    }
+
+    struct {
+        s32 glfw;
+        u32 bit;
+    } keys[] = {
+        {GLFW_KEY_W, INPUT_KEY_W},
+        {GLFW_KEY_A, INPUT_KEY_A},
+        {GLFW_KEY_S, INPUT_KEY_S},
+        {GLFW_KEY_D, INPUT_KEY_D},
+        {GLFW_KEY_R, INPUT_KEY_R},
+        {GLFW_KEY_F, INPUT_KEY_F},
+        {GLFW_KEY_Q, INPUT_KEY_Q},
+        {GLFW_KEY_E, INPUT_KEY_E},
+    };
+    
+    in.keys = 0;
+    for (u32 i = 0; i < length_of(keys); i++) {
+        if (glfwGetKey(w->handle, keys[i].glfw) == GLFW_PRESS) in.keys |= keys[i].bit;
+    }
+
+    return in;
+}
+
 void key_callback(GLFWwindow* window, s32 key, s32 scancode, s32 action, s32 mods) {
 
     if (action == GLFW_PRESS) {
@@ -1370,38 +3424,54 @@ void key_callback(GLFWwindow* window, s32 key, s32 scancode, s32 action, s32 mod
             case GLFW_KEY_F1:     toggle_vsync();             break;
             case GLFW_KEY_F2:     toggle_cursor();            break;
             case GLFW_KEY_F3:     toggle_debug_info();        break;
+            case GLFW_KEY_F4:     profiler_capture("data/trace.json", TRACE_HOTKEY_FRAMES); break;
             case GLFW_KEY_F11:    toggle_fullscreen();        break;
            
-            case GLFW_KEY_Z:      change_draw_mode(-1);       break;
-            case GLFW_KEY_X:      change_draw_mode(1);        break;
-
-            case GLFW_KEY_SPACE:  pause_or_continue();        break;
-            case GLFW_KEY_DOWN:   change_engine_speed(0.5);   break;
-            case GLFW_KEY_UP:     change_engine_speed(2);     break;
-            case GLFW_KEY_LEFT:   change_movement_speed(0.5); break;
-            case GLFW_KEY_RIGHT:  change_movement_speed(2);   break;
+            // these change simulation state, so they go through the InputFrame
+            case GLFW_KEY_Z:      push_input_event(INPUT_EVENT_DRAW_MODE, -1);        break;
+            case GLFW_KEY_X:      push_input_event(INPUT_EVENT_DRAW_MODE,  1);        break;
+
+            case GLFW_KEY_SPACE:  push_input_event(INPUT_EVENT_PAUSE, 0);             break;
+            case GLFW_KEY_DOWN:   push_input_event(INPUT_EVENT_ENGINE_SPEED,   0.5);  break;
+            case GLFW_KEY_UP:     push_input_event(INPUT_EVENT_ENGINE_SPEED,   2);    break;
+            case GLFW_KEY_LEFT:   push_input_event(INPUT_EVENT_MOVEMENT_SPEED, 0.5);  break;
+            case GLFW_KEY_RIGHT:  push_input_event(INPUT_EVENT_MOVEMENT_SPEED, 2);    break;
         }
     }
 }
 
 void scroll_callback(GLFWwindow* window, f64 dx, f64 dy) {
-    camera.FOV = clamp_f32(camera.FOV + dy, 1, 179);
-    update_camera_projection(&camera);
+    push_input_event(INPUT_EVENT_ZOOM, dy);
 }
 
 void mouse_button_callback(GLFWwindow* window, s32 button, s32 action, s32 mods) {
     if (action == GLFW_PRESS) {
         switch (button) {
-            case GLFW_MOUSE_BUTTON_MIDDLE: {
-                camera.FOV = 70;
-                camera.zx  = 0;
-                update_camera_projection(&camera);
-                break;
-            }
+            case GLFW_MOUSE_BUTTON_MIDDLE: push_input_event(INPUT_EVENT_RESET_VIEW, 0); break;
         }
     }
 }
 
+// main thread, the one place the simulation's input comes from: a log, the benchmark or the live window
+InputFrame next_input(u32 frame, f64 dt) {
+
+    InputFrame in;
+    
+    if (bench_options.replay_input) {
+        pending_input.event_count = 0; // live input is ignored
+        if (!input_log_read(&input_replay, &in)) in = (InputFrame) {.quit = 1, .height = window_info.height, .aspect = window_info.aspect};
+        in.quit |= glfwWindowShouldClose(window_info.handle);
+    } else if (bench_options.enabled) {
+        in = bench_input(frame);
+    } else {
+        in = gather_input(dt);
+    }
+    
+    if (bench_options.record_input) input_log_write(&input_record, &in);
+    
+    return in;
+}
+
 
 
 
@@ -1410,17 +3480,33 @@ void mouse_button_callback(GLFWwindow* window, s32 button, s32 action, s32 mods)
 
 void setup(s32 arg_count, char** args) {
 
+    profiler_init();
+    profiler_thread("main");
+    profile_begin("setup");
+
 
     /* ---- Setup Runtime ---- */
     {
         u64 size = 1024 * 256;
-        runtime.temp_buffer.data = calloc(size, sizeof(u8));
+        runtime.temp_buffer.data = heap_alloc_zero(sizeof(u8) * size, ALLOC_RUNTIME);
         runtime.temp_buffer.size = size;
-        runtime.alloc    = malloc;
+        runtime.alloc    = default_alloc;
         runtime.log_file = stdout;
+
+        pool_init(&meshes,   sizeof(Mesh),    MESH_MAX_COUNT);
+        pool_init(&textures, sizeof(Texture), TEXTURE_MAX_COUNT);
+
+        uniform_names = (Uniform_Names) {
+            .transform = intern(string("transform")),
+            .color     = intern(string("color")),
+            .position  = intern(string("position")),
+            .offset    = intern(string("offset")),
+            .model     = intern(string("model")),
+            .texture0  = intern(string("texture0")),
+        };
         
         runtime.command_line_args = (Array(String)) {
-            .data  = malloc(sizeof(String) * arg_count),
+            .data  = heap_alloc(sizeof(String) * arg_count, ALLOC_RUNTIME),
             .count = arg_count,
         };
 
@@ -1429,10 +3515,18 @@ void setup(s32 arg_count, char** args) {
             s->data  = (u8*) args[i];
             s->count = strlen(args[i]);
         }
+
+        parse_command_line();
+        if (bench_options.trace_path) profiler_capture(bench_options.trace_path, PROFILER_CAPTURE_ALL);
+        if (bench_options.map) {
+            map_benchmark();
+            exit(0);
+        }
     }
    
 
     /* ---- Init Window and OpenGL ---- */
+    profile_begin("window");
     {
         WindowInfo* w = &window_info;
         setvbuf(stdout, NULL, _IONBF, 0); // force mitty to print immediately
@@ -1446,6 +3540,12 @@ void setup(s32 arg_count, char** args) {
         
         // glfwWindowHint(GLFW_SAMPLES, 8); // quick permanent anti-aliasing, switch to shader-based later
 
+        // benchmark: nothing on screen, and we want the real frame time, not the refresh rate
+        if (bench_options.enabled) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            w->vsync = 0;
+        }
+
         // set window and load OpenGL functions
         w->handle = glfwCreateWindow(w->width, w->height, "Engine", NULL, NULL);
         glfwMakeContextCurrent(w->handle);
@@ -1467,7 +3567,24 @@ void setup(s32 arg_count, char** args) {
         w->is_first_frame = 1;
         camera.view = M4_IDENTITY;
         resize_framebuffer(w->handle, w->width, w->height);
+
+        glGenBuffers(1, &frame_uniform_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frame_uniform_buffer);
+
+        stream_buffer_init(&stream_vertices,  GL_ARRAY_BUFFER,         1024 * 1024);
+        stream_buffer_init(&stream_instances, GL_ARRAY_BUFFER,         1024 * 1024 * 4);
+        stream_buffer_init(&stream_indirect,  GL_DRAW_INDIRECT_BUFFER, 1024 * 256);
+        glGenVertexArrays(1, &stream_vertices_vao);
+        glBindVertexArray(stream_vertices_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream_vertices.id);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*) 0);
+        glEnableVertexAttribArray(0);
+
+        pass_timers_init();
     }
+    profile_end();
 
 
     /* ---- Setup Debug (comment out to disable) ---- */
@@ -1492,6 +3609,7 @@ void setup(s32 arg_count, char** args) {
     {
 
         // Load All Textures 
+        profile_begin("textures");
         {
             Asset_Textures* t = &asset_textures;
 
@@ -1504,8 +3622,10 @@ void setup(s32 arg_count, char** args) {
             t->styxel_8x8  = load_texture("data/fonts/styxel_8x8.png", 4);
             t->sb_16x16    = load_texture("data/fonts/sb_16x16_trans.png", 4);
         }
+        profile_end();
 
         // Compile All Shaders 
+        profile_begin("shaders");
         {
             Asset_Shaders* s = &asset_shaders;
 
@@ -1515,15 +3635,27 @@ void setup(s32 arg_count, char** args) {
             s->font = compile_shader("data/shaders/font.glsl");
             s->quad = compile_shader("data/shaders/quad.glsl");
         }
+        profile_end();
         
         // Load Meshes 
+        profile_begin("meshes");
         {
             make_geometry_primitives();
-            fill_mesh_alphabet(&mesh_alphabet, &asset_textures.styxel, 6, 6);
+            fill_mesh_alphabet(&mesh_alphabet, texture_get(asset_textures.styxel), 6, 6);
         }
+        profile_end();
         
-        load_position(&camera);
+        // a benchmark always starts from the default camera, a replay from where the recording started
+        if      (bench_options.replay_input) load_input_log(&input_replay, bench_options.replay_input, &camera);
+        else if (bench_options.enabled)      load_camera_path(&camera_path, bench_options.camera_path);
+        else                                 load_position(&camera);
+
+        if (bench_options.enabled && bench_options.replay_input) bench_options.frames = input_replay.frames + 1;
+        if (bench_options.record_input) input_log_begin(&input_record, &camera);
+        if (bench_options.record_path)  camera_path_begin_record(&camera_path, bench_options.camera_path);
     }
+
+    profile_end();
 }
 
 
@@ -1535,68 +3667,257 @@ void setup(s32 arg_count, char** args) {
 
 /* ==== Process ==== */
 
-void process_inputs(f64 dt) {
-
-    WindowInfo* w = &window_info;
-    Camera*   cam = &camera;
-    f64 mdx, mdy; // delta for mouse position
-    {
-        f64 mx, my;
-        glfwGetCursorPos(window_info.handle, &mx, &my);
-        mdx = mx - w->cursor.x;
-        mdy = my - w->cursor.y;
-        w->cursor.x = mx;
-        w->cursor.y = my;
+// simulation thread, once per frame before stepping
+void apply_input_events(InputFrame* in) {
+    for (u32 i = 0; i < in->event_count; i++) {
+        InputEvent* e = &in->events[i];
+        switch (e->type) {
+            case INPUT_EVENT_DRAW_MODE:      change_draw_mode(e->value);      break;
+            case INPUT_EVENT_ENGINE_SPEED:   change_engine_speed(e->value);   break;
+            case INPUT_EVENT_MOVEMENT_SPEED: change_movement_speed(e->value); break;
+            case INPUT_EVENT_PAUSE:          pause_or_continue();             break;
+            case INPUT_EVENT_ZOOM:           camera.FOV = clamp_f32(camera.FOV + e->value, 1, 179); break;
+            case INPUT_EVENT_RESET_VIEW: {
+                camera.FOV = 70;
+                camera.zx  = 0;
+                break;
+            }
+        }
     }
+}
 
-    Vector3 dv = {0};
-    // Rotor3D dr = {1, 0, 0, 0}; // 3-way free camera
+// once per frame with the real dt, so looking around stays as smooth as the frame rate
+void process_mouse_look(InputFrame* in) {
 
-    float factor = 10 * movement_speed_scale;
+    Camera* cam = &camera;
+    f64     dt  = in->dt;
 
-    if (glfwGetKey(w->handle, GLFW_KEY_D) == GLFW_PRESS) dv.x  =  dt * factor;
-    if (glfwGetKey(w->handle, GLFW_KEY_A) == GLFW_PRESS) dv.x  = -dt * factor;
-    if (glfwGetKey(w->handle, GLFW_KEY_W) == GLFW_PRESS) dv.y  =  dt * factor;
-    if (glfwGetKey(w->handle, GLFW_KEY_S) == GLFW_PRESS) dv.y  = -dt * factor;
-    if (glfwGetKey(w->handle, GLFW_KEY_R) == GLFW_PRESS) dv.z  =  dt * factor;
-    if (glfwGetKey(w->handle, GLFW_KEY_F) == GLFW_PRESS) dv.z  = -dt * factor;
+    // Rotor3D dr = {1, 0, 0, 0}; // 3-way free camera
 
     // 3-way free camera
-    // if (glfwGetKey(w->handle, GLFW_KEY_Q) == GLFW_PRESS) dr.zx = -TAU * dt * 0.1;
-    // if (glfwGetKey(w->handle, GLFW_KEY_E) == GLFW_PRESS) dr.zx =  TAU * dt * 0.1;
+    // if (in->keys & INPUT_KEY_Q) dr.zx = -TAU * dt * 0.1;
+    // if (in->keys & INPUT_KEY_E) dr.zx =  TAU * dt * 0.1;
     // 3-way free camera
-    // dr.yz -= mdy * 0.001;
-    // dr.xy -= mdx * 0.001;
+    // dr.yz -= in->mouse_dy * 0.001;
+    // dr.xy -= in->mouse_dx * 0.001;
 
-    if (w->cursor_visible) return;
+    if (in->cursor_visible) return;
     
-    // ehh... is there a better solution?
-    if (w->is_first_frame) {
-        w->is_first_frame = 0;
-        update_camera_projection(&camera);
-        // dr = (Rotor3D) {1, 0, 0, 0}; // 3-way free camera
-    } else {
-        if (glfwGetKey(w->handle, GLFW_KEY_Q) == GLFW_PRESS) cam->zx += -TAU * dt * 0.3;
-        if (glfwGetKey(w->handle, GLFW_KEY_E) == GLFW_PRESS) cam->zx +=  TAU * dt * 0.3;
-        cam->yz = clamp_f32(cam->yz - mdy * mouse_speed, -0.22 * TAU, 0.22 * TAU);
-        cam->xy = fmod(     cam->xy - mdx * mouse_speed, TAU);
-    }
+    if (in->keys & INPUT_KEY_Q) cam->zx += -TAU * dt * 0.3;
+    if (in->keys & INPUT_KEY_E) cam->zx +=  TAU * dt * 0.3;
+    cam->yz = clamp_f32(cam->yz - in->mouse_dy * mouse_speed, -0.22 * TAU, 0.22 * TAU);
+    cam->xy = fmod(     cam->xy - in->mouse_dx * mouse_speed, TAU);
 
     // 3-way free camera, todo: understand this. reverse order here (first delta then prev orientation), 
     // and we can get correct behavior, but why? maybe because we need to reverse it later, so we need opposite order?
     // cam->orientation = r3d_mul(r3d_normalize(dr), cam->orientation); 
     
-    // zx -> yz -> xy (reverse is xy -> yz -> zx, so the "reverse order" above seems to be a thing?)
-    cam->orientation = r3d_mul(
-        r3d_mul(
-            r3d_from_plane_angle(B3_ZX, cam->zx), 
-            r3d_from_plane_angle(B3_YZ, cam->yz)
-        ),
-        r3d_from_plane_angle(B3_XY, cam->xy)
-    );
+    update_camera_orientation(cam);
+}
+
+// once per simulation step, dt is SIM_DT
+void process_inputs(InputFrame* in, f64 dt) {
 
-    cam->position    = v3_add(cam->position, v3_rotate(dv, cam->orientation));
-    cam->view        = m4_mul(r3d_to_m4(r3d_reverse(cam->orientation)), m4_translate(v3_reverse(cam->position))); // reverse pos and orientation to get world transform
+    Camera* cam = &camera;
+
+    if (in->cursor_visible) return;
+
+    profile_begin("process_inputs");
+
+    Vector3 dv = {0};
+
+    float factor = 10 * movement_speed_scale;
+
+    if (in->keys & INPUT_KEY_D) dv.x  =  dt * factor;
+    if (in->keys & INPUT_KEY_A) dv.x  = -dt * factor;
+    if (in->keys & INPUT_KEY_W) dv.y  =  dt * factor;
+    if (in->keys & INPUT_KEY_S) dv.y  = -dt * factor;
+    if (in->keys & INPUT_KEY_R) dv.z  =  dt * factor;
+    if (in->keys & INPUT_KEY_F) dv.z  = -dt * factor;
+
+    cam->position = v3_add(cam->position, v3_rotate(dv, cam->orientation));
+
+    profile_end();
+}
+
+
+
+
+
+/* ==== Simulation ==== */
+
+/*
+    the simulation always steps by SIM_DT, rendering runs at whatever rate it gets,
+    every frame we add the real dt to the accumulator and take as many whole steps as fit,
+    the remainder (alpha) is how far render time is between the last two steps, we draw state lerped by that
+
+    usage:
+        fixed_step_begin(&step, dt);
+        while (fixed_step_next(&step)) {
+            previous = current;
+            simulate(&current, SIM_DT);
+        }
+        draw(lerp_entity(previous, current, step.alpha));
+*/
+
+#define SIM_HZ        60
+#define SIM_DT        (1.0 / SIM_HZ)
+#define SIM_MAX_STEPS 8 // per frame, after a stall (breakpoint, window drag) we drop the time instead of trying to catch up
+
+typedef struct {
+    f64 accumulator;
+    f64 alpha; // 0..1, valid after fixed_step_next() returned 0
+    u32 steps; // taken this frame
+    u64 total; // taken since start, sim time is total * SIM_DT
+} FixedStep;
+
+void fixed_step_begin(FixedStep* s, f64 dt) {
+    s->accumulator += dt;
+    s->steps        = 0;
+}
+
+u8 fixed_step_next(FixedStep* s) {
+
+    if (s->steps == SIM_MAX_STEPS) s->accumulator = fmod(s->accumulator, SIM_DT);
+    
+    if (s->accumulator < SIM_DT) {
+        s->alpha = s->accumulator / SIM_DT;
+        return 0;
+    }
+
+    s->accumulator -= SIM_DT;
+    s->steps++;
+    s->total++;
+    return 1;
+}
+
+Entity3D lerp_entity(Entity3D a, Entity3D b, f32 t) {
+    return (Entity3D) {
+        .position    = lerp_v3(a.position, b.position, t),
+        .scale       = lerp_v3(a.scale,    b.scale,    t),
+        .orientation = nlerp_r3d(a.orientation, b.orientation, t),
+    };
+}
+
+void update_camera_view(Camera* cam) {
+    cam->view = m4_mul(r3d_to_m4(r3d_reverse(cam->orientation)), m4_translate(v3_reverse(cam->position))); // reverse pos and orientation to get world transform
+}
+
+// only the position is lerped, orientation is the latest so mouse look does not lag a step behind
+Camera lerp_camera(Vector3 previous_position, Camera* cam, f32 t, f32 aspect) {
+    Camera out   = *cam;
+    out.position = lerp_v3(previous_position, cam->position, t);
+    update_camera_view(&out);
+    update_camera_projection(&out, aspect);
+    return out;
+}
+
+
+
+
+/* ==== Frame Pipeline ==== */
+
+/*
+    usage, main thread:
+        pipeline_start(&p, simulation_thread, &sim);
+        pipeline_submit_input(&p, &first_input);
+        while (1) {
+            FrameState* s = pipeline_acquire_state(&p);
+            ...poll, pipeline_submit_input(&p, &next_input)...   // simulation starts on the next frame now
+            ...draw s...
+            pipeline_release_state(&p);
+            if (s->quit) break;
+        }
+        pipeline_stop(&p);
+
+    simulation thread:
+        while (1) {
+            InputFrame  in;
+            FrameState* s = pipeline_begin_state(&p, &in);
+            ...simulate, fill s...
+            pipeline_end_state(&p);
+            if (in.quit) break;
+        }
+*/
+
+void pipeline_start(FramePipeline* p, void (*simulation)(void*), void* data) {
+    p->input_ready = semaphore_create(0);
+    p->state_ready = semaphore_create(0);
+    p->state_free  = semaphore_create(length_of(p->states));
+    p->write       = 0;
+    p->read        = 0;
+    p->thread      = thread_start(simulation, data);
+}
+
+// after the last state with quit set was released
+void pipeline_stop(FramePipeline* p) {
+    thread_join(p->thread);
+    semaphore_destroy(p->input_ready);
+    semaphore_destroy(p->state_ready);
+    semaphore_destroy(p->state_free);
+}
+
+void pipeline_submit_input(FramePipeline* p, InputFrame* in) {
+    p->input = *in;
+    semaphore_signal(p->input_ready);
+}
+
+FrameState* pipeline_acquire_state(FramePipeline* p) {
+    semaphore_wait(p->state_ready);
+    return &p->states[p->read];
+}
+
+void pipeline_release_state(FramePipeline* p) {
+    p->read = (p->read + 1) % length_of(p->states);
+    semaphore_signal(p->state_free);
+}
+
+FrameState* pipeline_begin_state(FramePipeline* p, InputFrame* in_out) {
+    
+    semaphore_wait(p->input_ready);
+    *in_out = p->input;
+    
+    semaphore_wait(p->state_free);
+    FrameState* s = &p->states[p->write];
+    s->model_count = 0;
+    s->text_count  = 0;
+    s->text_used   = 0;
+    s->quit        = in_out->quit;
+    return s;
+}
+
+void pipeline_end_state(FramePipeline* p) {
+    p->write = (p->write + 1) % length_of(p->states);
+    semaphore_signal(p->state_ready);
+}
+
+// printf into the state's own text storage, the simulation cannot use temp_print()
+void frame_text(FrameState* s, Vector2 position, Vector2 scale, Vector2 offset, Vector4 color, Vector4 shadow_color, char* format, ...) {
+
+    if (s->text_count == FRAME_MAX_TEXTS) return;
+
+    u64 left = FRAME_TEXT_BYTES - s->text_used;
+    if (!left) return;
+
+    StringBuilder b;
+    builder_init_fixed(&b, s->text_data + s->text_used, left - 1); // cut off, keeps room for the 0
+
+    va_list va;
+    va_start(va, format);
+    u64 count = builder_vprint(&b, format, va);
+    va_end(va);
+    
+    b.base.data[count] = 0;
+
+    s->texts[s->text_count++] = (TextCommand) {
+        .position     = position,
+        .scale        = scale,
+        .offset       = offset,
+        .color        = color,
+        .shadow_color = shadow_color,
+        .text         = {s->text_data + s->text_used, count},
+    };
+    s->text_used += count + 1;
 }
 
 
@@ -1703,13 +4024,13 @@ void test_print(Vector2 position, String s) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    glBindTexture(GL_TEXTURE_2D, asset_textures.test.id); //temp_tex_id);
+    glBindTexture(GL_TEXTURE_2D, texture_get(asset_textures.test)->id); //temp_tex_id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glActiveTexture(GL_TEXTURE0);
-    glUniform1i(glGetUniformLocation(shader, "texture0"), 0);
+    glUniform1i(uniform_location(shader, uniform_names.texture0), 0);
     
     
     for (u64 i = 0; i < s.count; i++) {
@@ -0,0 +1,535 @@
+/*
+
+==== Note ====
+
+bounding volume hierarchy over world space AABBs
+
+- built with binned SAH, stored as a flat array of 32 byte nodes in depth first order,
+  left child is always the next node, so only the right child index is stored
+- items are referred to by the index the caller used when building (e.g. index into a scene list),
+  the BVH never touches the objects themselves
+- moving objects: update the item bounds with bvh_update_item() (walks up to the root),
+  or write many bounds then call bvh_refit() once, the topology is kept,
+  rebuild if things move very far from where they were at build time
+
+*/
+
+
+
+
+/* ==== Data Types ==== */
+
+typedef struct {
+    Vector3 min;
+    Vector3 max;
+} AABB;
+
+typedef struct {
+    Vector3 origin;
+    Vector3 direction;
+} Ray;
+
+// plane as (normal, d), point p is inside when dot(normal, p) + d >= 0
+typedef struct {
+    Vector4 planes[6];
+} Frustum;
+
+typedef struct {
+    Vector3 min;
+    u32     offset; // leaf: first slot in BVH.items, interior: index of the right child
+    Vector3 max;
+    u32     count;  // item count for leaf, 0 for interior
+} BVHNode;
+
+typedef struct {
+
+    BVHNode* nodes;
+    u32*     parents;     // parent node of every node, root has BVH_NONE
+    u32      node_count;
+    u32      depth;       // of the deepest node, the root is 0, sizes the traversal stacks
+
+    u32*     items;       // item ids in leaf order
+    u32*     item_leaf;   // leaf node of every item id
+    AABB*    item_bounds; // indexed by item id
+    u32      item_count;
+
+} BVH;
+
+
+
+
+/* ==== Constants ==== */
+
+#define BVH_NONE        0xffffffff
+#define BVH_BIN_COUNT   12
+#define BVH_MAX_LEAF    4
+#define BVH_STACK_SIZE  128 // on the stack, deeper trees take a traversal stack from the heap, see bvh_stack_begin()
+
+const AABB AABB_EMPTY = {
+    { 1e30,  1e30,  1e30},
+    {-1e30, -1e30, -1e30},
+};
+
+
+
+
+/* ==== AABB ==== */
+
+AABB aabb_union(AABB a, AABB b) {
+    return (AABB) {v3_min(a.min, b.min), v3_max(a.max, b.max)};
+}
+
+AABB aabb_add_point(AABB a, Vector3 p) {
+    return (AABB) {v3_min(a.min, p), v3_max(a.max, p)};
+}
+
+Vector3 aabb_center(AABB a) {
+    return v3_scale(v3_add(a.min, a.max), 0.5);
+}
+
+// half of the surface area, only used as a relative cost
+f32 aabb_half_area(AABB a) {
+    Vector3 d = v3_sub(a.max, a.min);
+    if (d.x < 0 || d.y < 0 || d.z < 0) return 0;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+u8 aabb_overlap(AABB a, AABB b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x
+        && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// slab test, inv_dir is 1 / ray direction, returns entry distance or -1 if miss
+f32 aabb_ray_distance(Vector3 min, Vector3 max, Vector3 origin, Vector3 inv_dir, f32 max_t) {
+
+    f32 tx1 = (min.x - origin.x) * inv_dir.x;
+    f32 tx2 = (max.x - origin.x) * inv_dir.x;
+    f32 ty1 = (min.y - origin.y) * inv_dir.y;
+    f32 ty2 = (max.y - origin.y) * inv_dir.y;
+    f32 tz1 = (min.z - origin.z) * inv_dir.z;
+    f32 tz2 = (max.z - origin.z) * inv_dir.z;
+
+    f32 t_near = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)), fminf(tz1, tz2));
+    f32 t_far  = fminf(fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2)), fmaxf(tz1, tz2));
+
+    if (t_far < 0 || t_near > t_far || t_near > max_t) return -1;
+    return t_near > 0 ? t_near : 0;
+}
+
+
+
+
+/* ==== Frustum ==== */
+
+// M is projection * view, planes come straight from the rows (Gribb & Hartmann),
+// our projection keeps depth in y and the shader swizzles it, but since we take
+// w +- every row, the set of planes is the same either way
+Frustum frustum_from_m4(Matrix4 M) {
+
+    f32* m = (f32*) &M;
+    Vector4 row[4];
+    for (s32 i = 0; i < 4; i++) row[i] = (Vector4) {m[0 + i], m[4 + i], m[8 + i], m[12 + i]};
+
+    Frustum f;
+    for (s32 i = 0; i < 3; i++) {
+        f.planes[i * 2 + 0] = (Vector4) {row[3].x + row[i].x, row[3].y + row[i].y, row[3].z + row[i].z, row[3].w + row[i].w};
+        f.planes[i * 2 + 1] = (Vector4) {row[3].x - row[i].x, row[3].y - row[i].y, row[3].z - row[i].z, row[3].w - row[i].w};
+    }
+
+    return f;
+}
+
+// 0: outside, 1: intersecting, 2: fully inside
+s32 frustum_test_aabb(Frustum* f, Vector3 min, Vector3 max) {
+
+    s32 result = 2;
+    for (s32 i = 0; i < 6; i++) {
+
+        Vector4 p = f->planes[i];
+
+        // the corner furthest along the plane normal, and the one furthest against it
+        f32 far_d  = p.x * (p.x > 0 ? max.x : min.x) + p.y * (p.y > 0 ? max.y : min.y) + p.z * (p.z > 0 ? max.z : min.z) + p.w;
+        f32 near_d = p.x * (p.x > 0 ? min.x : max.x) + p.y * (p.y > 0 ? min.y : max.y) + p.z * (p.z > 0 ? min.z : max.z) + p.w;
+
+        if (far_d  < 0) return 0;
+        if (near_d < 0) result = 1;
+    }
+
+    return result;
+}
+
+
+
+
+/* ==== BVH: Build ==== */
+
+typedef struct {
+    AABB bounds;
+    u32  count;
+} BVHBin;
+
+AABB bvh_leaf_bounds(BVH* bvh, u32 first, u32 count) {
+    AABB b = AABB_EMPTY;
+    for (u32 i = first; i < first + count; i++) b = aabb_union(b, bvh->item_bounds[bvh->items[i]]);
+    return b;
+}
+
+void bvh_make_leaf(BVH* bvh, u32 node_index, u32 first, u32 count) {
+    BVHNode* node = &bvh->nodes[node_index];
+    node->offset = first;
+    node->count  = count;
+    for (u32 i = first; i < first + count; i++) bvh->item_leaf[bvh->items[i]] = node_index;
+}
+
+u32 bvh_build_node(BVH* bvh, Vector3* centroids, u32 parent, u32 depth, u32 first, u32 count) {
+
+    u32 node_index = bvh->node_count++;
+    if (depth > bvh->depth) bvh->depth = depth;
+
+    AABB bounds    = bvh_leaf_bounds(bvh, first, count);
+    AABB centroid  = AABB_EMPTY;
+    for (u32 i = first; i < first + count; i++) centroid = aabb_add_point(centroid, centroids[bvh->items[i]]);
+
+    bvh->parents[node_index]   = parent;
+    bvh->nodes[node_index].min = bounds.min;
+    bvh->nodes[node_index].max = bounds.max;
+
+    if (count <= 1) {
+        bvh_make_leaf(bvh, node_index, first, count);
+        return node_index;
+    }
+
+    // find the cheapest split plane over all axes
+    s32 best_axis  = -1;
+    s32 best_split = 0;
+    f32 best_cost  = 1e30;
+
+    for (s32 axis = 0; axis < 3; axis++) {
+
+        f32 low  = ((f32*) &centroid.min)[axis];
+        f32 high = ((f32*) &centroid.max)[axis];
+        if (high - low < 1e-6) continue;
+
+        BVHBin bins[BVH_BIN_COUNT];
+        for (s32 i = 0; i < BVH_BIN_COUNT; i++) bins[i] = (BVHBin) {AABB_EMPTY, 0};
+
+        f32 scale = BVH_BIN_COUNT / (high - low);
+        for (u32 i = first; i < first + count; i++) {
+            u32 item = bvh->items[i];
+            s32 b    = (((f32*) &centroids[item])[axis] - low) * scale;
+            if (b > BVH_BIN_COUNT - 1) b = BVH_BIN_COUNT - 1;
+            bins[b].bounds = aabb_union(bins[b].bounds, bvh->item_bounds[item]);
+            bins[b].count++;
+        }
+
+        // sweep from both sides to get the area * count of every split
+        f32 left_cost[BVH_BIN_COUNT - 1];
+        AABB acc       = AABB_EMPTY;
+        u32  acc_count = 0;
+        for (s32 i = 0; i < BVH_BIN_COUNT - 1; i++) {
+            acc = aabb_union(acc, bins[i].bounds);
+            acc_count += bins[i].count;
+            left_cost[i] = aabb_half_area(acc) * acc_count;
+        }
+
+        acc       = AABB_EMPTY;
+        acc_count = 0;
+        for (s32 i = BVH_BIN_COUNT - 1; i > 0; i--) {
+            acc = aabb_union(acc, bins[i].bounds);
+            acc_count += bins[i].count;
+            f32 cost = left_cost[i - 1] + aabb_half_area(acc) * acc_count;
+            if (cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = i;
+            }
+        }
+    }
+
+    // SAH: traversal cost 1, intersection cost 1 per item
+    f32 area      = aabb_half_area(bounds);
+    f32 leaf_cost = count;
+    if (area > 0) best_cost = 1 + best_cost / area;
+
+    if (count <= BVH_MAX_LEAF && (best_axis < 0 || best_cost >= leaf_cost)) {
+        bvh_make_leaf(bvh, node_index, first, count);
+        return node_index;
+    }
+
+    // partition in place, fall back to the object median when all centroids are in one spot
+    u32 mid = first;
+    if (best_axis >= 0) {
+
+        f32 low   = ((f32*) &centroid.min)[best_axis];
+        f32 scale = BVH_BIN_COUNT / (((f32*) &centroid.max)[best_axis] - low);
+
+        u32 j = first + count;
+        while (mid < j) {
+            s32 b = (((f32*) &centroids[bvh->items[mid]])[best_axis] - low) * scale;
+            if (b > BVH_BIN_COUNT - 1) b = BVH_BIN_COUNT - 1;
+            if (b < best_split) {
+                mid++;
+            } else {
+                j--;
+                u32 temp       = bvh->items[mid];
+                bvh->items[mid] = bvh->items[j];
+                bvh->items[j]   = temp;
+            }
+        }
+    }
+    if (mid == first || mid == first + count) mid = first + count / 2;
+
+    bvh_build_node(bvh, centroids, node_index, depth + 1, first, mid - first);
+    u32 right = bvh_build_node(bvh, centroids, node_index, depth + 1, mid, first + count - mid);
+
+    bvh->nodes[node_index].offset = right;
+    bvh->nodes[node_index].count  = 0;
+
+    return node_index;
+}
+
+// bounds are copied, call again to rebuild with a different count
+void bvh_build(BVH* bvh, AABB* bounds, u32 count) {
+
+    if (bvh->nodes) {
+        heap_free(bvh->nodes);
+        heap_free(bvh->parents);
+        heap_free(bvh->items);
+        heap_free(bvh->item_leaf);
+        heap_free(bvh->item_bounds);
+    }
+
+    u32 node_capacity = count ? count * 2 - 1 : 1;
+
+    bvh->nodes       = heap_alloc(sizeof(BVHNode) * node_capacity, ALLOC_BVH);
+    bvh->parents     = heap_alloc(sizeof(u32)     * node_capacity, ALLOC_BVH);
+    bvh->items       = heap_alloc(sizeof(u32)     * (count + 1), ALLOC_BVH);
+    bvh->item_leaf   = heap_alloc(sizeof(u32)     * (count + 1), ALLOC_BVH);
+    bvh->item_bounds = heap_alloc(sizeof(AABB)    * (count + 1), ALLOC_BVH);
+    bvh->item_count  = count;
+    bvh->node_count  = 0;
+    bvh->depth       = 0;
+
+    Vector3* centroids = heap_alloc(sizeof(Vector3) * (count + 1), ALLOC_BVH);
+
+    for (u32 i = 0; i < count; i++) {
+        bvh->items[i]       = i;
+        bvh->item_bounds[i] = bounds[i];
+        centroids[i]        = aabb_center(bounds[i]);
+    }
+
+    bvh_build_node(bvh, centroids, BVH_NONE, 0, 0, count);
+
+    heap_free(centroids);
+}
+
+void bvh_free(BVH* bvh) {
+    heap_free(bvh->nodes);
+    heap_free(bvh->parents);
+    heap_free(bvh->items);
+    heap_free(bvh->item_leaf);
+    heap_free(bvh->item_bounds);
+    *bvh = (BVH) {0};
+}
+
+
+
+
+/* ==== BVH: Refit ==== */
+
+// children always come after their parent, so walking backwards refits bottom up
+void bvh_refit(BVH* bvh) {
+
+    for (s32 i = bvh->node_count - 1; i >= 0; i--) {
+
+        BVHNode* node = &bvh->nodes[i];
+        AABB b;
+
+        if (node->count) {
+            b = bvh_leaf_bounds(bvh, node->offset, node->count);
+        } else {
+            BVHNode* l = &bvh->nodes[i + 1];
+            BVHNode* r = &bvh->nodes[node->offset];
+            b = aabb_union((AABB) {l->min, l->max}, (AABB) {r->min, r->max});
+        }
+
+        node->min = b.min;
+        node->max = b.max;
+    }
+}
+
+// O(depth), for a handful of moving objects per frame
+void bvh_update_item(BVH* bvh, u32 item, AABB bounds) {
+
+    bvh->item_bounds[item] = bounds;
+
+    u32 i = bvh->item_leaf[item];
+    {
+        BVHNode* node = &bvh->nodes[i];
+        AABB b = bvh_leaf_bounds(bvh, node->offset, node->count);
+        node->min = b.min;
+        node->max = b.max;
+    }
+
+    for (i = bvh->parents[i]; i != BVH_NONE; i = bvh->parents[i]) {
+
+        BVHNode* node = &bvh->nodes[i];
+        BVHNode* l    = &bvh->nodes[i + 1];
+        BVHNode* r    = &bvh->nodes[node->offset];
+        AABB b = aabb_union((AABB) {l->min, l->max}, (AABB) {r->min, r->max});
+
+        if (!memcmp(&b.min, &node->min, sizeof(Vector3)) && !memcmp(&b.max, &node->max, sizeof(Vector3))) break;
+        node->min = b.min;
+        node->max = b.max;
+    }
+}
+
+
+
+
+/* ==== BVH: Queries ==== */
+
+// a depth first walk holds at most depth + 1 nodes, skewed trees can outgrow the local array, those get a heap one for the query
+u32* bvh_stack_begin(BVH* bvh, u32* local) {
+    if (bvh->depth + 1 <= BVH_STACK_SIZE) return local;
+    return heap_alloc(sizeof(u32) * (bvh->depth + 1), ALLOC_BVH);
+}
+
+void bvh_stack_end(u32* stack, u32* local) {
+    if (stack != local) heap_free(stack);
+}
+
+// writes the visible item ids to out, returns the count (never more than capacity)
+u32 bvh_query_frustum(BVH* bvh, Frustum* f, u32* out, u32 capacity) {
+
+    if (!bvh->node_count || !bvh->item_count) return 0;
+
+    // high bit marks subtrees already known to be fully inside, so we skip the plane tests
+    const u32 inside_bit = 0x80000000;
+
+    u32  local[BVH_STACK_SIZE];
+    u32* stack = bvh_stack_begin(bvh, local);
+    u32 top   = 0;
+    u32 found = 0;
+
+    stack[top++] = 0;
+    while (top) {
+
+        u32 entry  = stack[--top];
+        u32 inside = entry & inside_bit;
+        BVHNode* node = &bvh->nodes[entry & ~inside_bit];
+
+        if (!inside) {
+            s32 r = frustum_test_aabb(f, node->min, node->max);
+            if (r == 0) continue;
+            if (r == 2) inside = inside_bit;
+        }
+
+        if (node->count) {
+            for (u32 i = node->offset; i < node->offset + node->count; i++) {
+                u32 item = bvh->items[i];
+                if (!inside) {
+                    AABB b = bvh->item_bounds[item];
+                    if (!frustum_test_aabb(f, b.min, b.max)) continue;
+                }
+                if (found == capacity) goto done;
+                out[found++] = item;
+            }
+        } else {
+            assert(top + 2 <= bvh->depth + 1);
+            stack[top++] = node->offset                    | inside;
+            stack[top++] = (u32) (node - bvh->nodes + 1)  | inside;
+        }
+    }
+
+    done:
+    bvh_stack_end(stack, local);
+    return found;
+}
+
+u32 bvh_query_aabb(BVH* bvh, AABB box, u32* out, u32 capacity) {
+
+    if (!bvh->node_count || !bvh->item_count) return 0;
+
+    u32  local[BVH_STACK_SIZE];
+    u32* stack = bvh_stack_begin(bvh, local);
+    u32 top   = 0;
+    u32 found = 0;
+
+    stack[top++] = 0;
+    while (top) {
+
+        BVHNode* node = &bvh->nodes[stack[--top]];
+        if (!aabb_overlap(box, (AABB) {node->min, node->max})) continue;
+
+        if (node->count) {
+            for (u32 i = node->offset; i < node->offset + node->count; i++) {
+                u32 item = bvh->items[i];
+                if (!aabb_overlap(box, bvh->item_bounds[item])) continue;
+                if (found == capacity) goto done;
+                out[found++] = item;
+            }
+        } else {
+            assert(top + 2 <= bvh->depth + 1);
+            stack[top++] = node->offset;
+            stack[top++] = node - bvh->nodes + 1;
+        }
+    }
+
+    done:
+    bvh_stack_end(stack, local);
+    return found;
+}
+
+// closest item whose bounds the ray hits, BVH_NONE if nothing, distance is along the (normalized) direction
+u32 bvh_raycast(BVH* bvh, Ray ray, f32 max_t, f32* t_out) {
+
+    if (!bvh->node_count || !bvh->item_count) return BVH_NONE;
+
+    Vector3 inv = {1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z};
+
+    u32  local[BVH_STACK_SIZE];
+    u32* stack = bvh_stack_begin(bvh, local);
+    u32 top  = 0;
+    u32 hit  = BVH_NONE;
+    f32 best = max_t;
+
+    stack[top++] = 0;
+    while (top) {
+
+        BVHNode* node = &bvh->nodes[stack[--top]];
+        if (aabb_ray_distance(node->min, node->max, ray.origin, inv, best) < 0) continue;
+
+        if (node->count) {
+            for (u32 i = node->offset; i < node->offset + node->count; i++) {
+                u32  item = bvh->items[i];
+                AABB b    = bvh->item_bounds[item];
+                f32  t    = aabb_ray_distance(b.min, b.max, ray.origin, inv, best);
+                if (t >= 0 && t < best) {
+                    best = t;
+                    hit  = item;
+                }
+            }
+        } else {
+
+            // visit the nearer child first so the far one is more likely to get culled by best
+            u32 l  = node - bvh->nodes + 1;
+            u32 r  = node->offset;
+            f32 tl = aabb_ray_distance(bvh->nodes[l].min, bvh->nodes[l].max, ray.origin, inv, best);
+            f32 tr = aabb_ray_distance(bvh->nodes[r].min, bvh->nodes[r].max, ray.origin, inv, best);
+
+            assert(top + 2 <= bvh->depth + 1);
+            if (tl >= 0 && tr >= 0) {
+                if (tl < tr) { stack[top++] = r; stack[top++] = l; }
+                else         { stack[top++] = l; stack[top++] = r; }
+            }
+            else if (tl >= 0) stack[top++] = l;
+            else if (tr >= 0) stack[top++] = r;
+        }
+    }
+
+    bvh_stack_end(stack, local);
+    if (t_out) *t_out = best;
+    return hit;
+}
@@ -21,6 +21,7 @@ char** get_all_matched_filename_c_strings(char* s, u64* count_out) {
 
 }
 
+// these come from the win32 layer's own malloc, not heap_alloc()
 void free_filename_c_strings(char** names, u64 count) {
     for (u64 i = 0; i < count; i++)  free(names[i]);
     free(names);
@@ -34,6 +35,8 @@ void free_filename_c_strings(char** names, u64 count) {
 
 String load_file(char* path) {
     
+    profile_begin("load_file");
+
     FILE* f = fopen(path, "rb");
     if (!f) error("Cannot load %s\n", path); 
 
@@ -48,11 +51,14 @@ String load_file(char* path) {
     fread(data, 1, count, f);
     fclose(f);
    
+    profile_end();
     return (String) {data, count};
 }
 
 char* load_file_as_c_string(char* path) {
 
+    profile_begin("load_file_as_c_string");
+
     FILE* f = fopen(path, "rb");
     if (!f) error("Cannot open file %s\n", path); 
 
@@ -65,6 +71,7 @@ char* load_file_as_c_string(char* path) {
     fread(buffer, 1, length, f);
     fclose(f);
 
+    profile_end();
     return buffer;
 }
 
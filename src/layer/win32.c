@@ -32,6 +32,19 @@ char** win32_get_all_matched_filename_c_strings(char* s, win32_u64* count_out);
 win32_u8* win32_load_file(char* s, win32_u64* count_out);
 win32_u8  win32_save_file(char* s, win32_u8* data, win32_u64 count);
 
+// handles are HANDLE, NULL on failure
+void* win32_thread_start(void (*proc)(void*), void* data);
+void  win32_thread_join(void* thread);
+
+void* win32_semaphore_create(win32_u64 initial);
+void  win32_semaphore_wait(void* semaphore);
+void  win32_semaphore_signal(void* semaphore);
+void  win32_semaphore_destroy(void* semaphore);
+
+// QueryPerformanceCounter
+win32_u64 win32_timer_ticks();
+win32_u64 win32_timer_frequency();
+
 #endif
 
 
@@ -224,6 +237,66 @@ win32_u8 win32_save_file(char* s, win32_u8* data, win32_u64 count) {
 }
 
 
+
+typedef struct {
+    void (*proc)(void*);
+    void* data;
+} win32_ThreadStart;
+
+DWORD WINAPI win32_thread_trampoline(LPVOID p) {
+    win32_ThreadStart start = *(win32_ThreadStart*) p;
+    free(p);
+    start.proc(start.data);
+    return 0;
+}
+
+void* win32_thread_start(void (*proc)(void*), void* data) {
+    
+    win32_ThreadStart* start = malloc(sizeof(win32_ThreadStart));
+    if (!start) return NULL;
+    start->proc = proc;
+    start->data = data;
+
+    HANDLE handle = CreateThread(NULL, 0, win32_thread_trampoline, start, 0, NULL);
+    if (!handle) free(start);
+    
+    return handle;
+}
+
+void win32_thread_join(void* thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void* win32_semaphore_create(win32_u64 initial) {
+    return CreateSemaphore(NULL, (LONG) initial, 0x7fffffff, NULL);
+}
+
+void win32_semaphore_wait(void* semaphore) {
+    WaitForSingleObject(semaphore, INFINITE);
+}
+
+void win32_semaphore_signal(void* semaphore) {
+    ReleaseSemaphore(semaphore, 1, NULL);
+}
+
+void win32_semaphore_destroy(void* semaphore) {
+    CloseHandle(semaphore);
+}
+
+win32_u64 win32_timer_ticks() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+win32_u64 win32_timer_frequency() {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return f.QuadPart;
+}
+
+
 #endif
 
 
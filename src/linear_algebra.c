@@ -125,6 +125,14 @@ f32 v3_length(Vector3 v) {
     return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
 }
 
+Vector3 v3_min(Vector3 a, Vector3 b) {
+    return (Vector3) {a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z};
+}
+
+Vector3 v3_max(Vector3 a, Vector3 b) {
+    return (Vector3) {a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z};
+}
+
 // will not check divide by zero
 Vector3 v3_normalize(Vector3 v) {
     f32 s = 1 / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
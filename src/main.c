@@ -1,3 +1,8 @@
+// clock_gettime under -std=c99, Windows goes through the win32 layer instead
+#ifndef OS_WINDOWS
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -6,6 +11,15 @@
 #include <math.h>
 #include <time.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef OS_WINDOWS
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
 
 
 /* ---- Third Party ---- */
@@ -35,12 +49,280 @@ __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 #include "runtime.c"
 #include "file.c"
 #include "linear_algebra.c"
+#include "bvh.c"
+#include "mesh_optimizer.c"
 #include "backend.c"
 
 
 
 
 
+/* ==== Simulation ==== */
+
+// everything the simulation thread owns, besides the globals camera, light and the speed scales
+typedef struct {
+
+    Model3D** scene; // the index here is the BVH item id
+    u32       scene_count;
+    Model3D*  object;
+    u32       object_id;
+    BVH       bvh;
+
+    FixedStep step;
+    Entity3D* previous; // scene_count, state at the start of the last step
+    Vector3   previous_camera;
+    Vector3   previous_light;
+
+    Timer     object_pulse;
+    Timer     text_pulse;
+    f64       time;
+
+    u32       frame;
+    u32       visible[FRAME_MAX_MODELS];
+    
+    FramePipeline* pipeline;
+
+} Simulation;
+
+void simulate_frame(Simulation* sim, InputFrame* in, FrameState* out) {
+
+    f64 dt = in->dt;
+    sim->time += dt;
+
+    apply_input_events(in);
+    process_mouse_look(in);
+
+    fixed_step_begin(&sim->step, dt);
+    while (fixed_step_next(&sim->step)) {
+
+        for (u32 i = 0; i < sim->scene_count; i++) sim->previous[i] = sim->scene[i]->base;
+        sim->previous_camera = camera.position;
+        sim->previous_light  = light;
+
+        process_inputs(in, SIM_DT);
+        if (bench_options.enabled && !bench_options.replay_input) camera_path_apply(&camera_path, sim->step.total - 1, &camera);
+        if (bench_options.record_path)                            camera_path_record(&camera_path, &camera);
+        sim->object_pulse.base += SIM_DT * engine_speed_scale;
+        
+        Model3D* object = sim->object;
+        f32 t = sin_normalize(sim->object_pulse.base);
+        object->base.orientation = nlerp_r3d(R3D_DEFAULT, r3d_from_plane_angle(B3_XY, TAU * 0.25), t);
+        object->base.position    = lerp_v3((Vector3) {0, 0, -5}, (Vector3) {0, 0, -3}, t);
+        
+        light = (Vector3) {cos(sim->object_pulse.base) * 20, sin(sim->object_pulse.base) * 20, 0};
+
+        bvh_update_item(&sim->bvh, sim->object_id, model_bounds(object));
+    }
+
+    sim->text_pulse.base += dt * 6; // purely visual, follows the frame rate
+
+    sim->frame++;
+
+
+    /* ---- 3D ---- */
+    
+    f32 alpha = sim->step.alpha;
+    
+    out->camera          = lerp_camera(sim->previous_camera, &camera, alpha, in->aspect);
+    out->light           = lerp_v3(sim->previous_light, light, alpha);
+    out->time            = sim->time;
+    out->dt              = dt;
+    out->show_debug_info = in->show_debug_info;
+
+    // draw copies in between the last two steps, the BVH only knows the latest step, close enough for culling
+    {
+        Frustum f = camera_frustum(&out->camera);
+        u32 visible_count = bvh_query_frustum(&sim->bvh, &f, sim->visible, FRAME_MAX_MODELS);
+        
+        for (u32 i = 0; i < visible_count; i++) {
+            u32 id = sim->visible[i];
+            out->models[i]      = *sim->scene[id];
+            out->models[i].base = lerp_entity(sim->previous[id], sim->scene[id]->base, alpha);
+        }
+        out->model_count = visible_count;
+    }
+
+
+    /* ---- 2D ---- */
+
+    {
+        Vector2 pos        = lerp_v2((Vector2) {-0.65, 0.7}, (Vector2) {-0.65, 0.72}, sin_normalize(sim->text_pulse.base));
+        Vector2 scale      = {0.1, 0.1}; 
+        Vector2 offset     = {0.005, -0.007};
+        Vector4 color      = lerp_v4((Vector4) {0.5, 0.7, 0.95, 1}, (Vector4) {0.2, 0.8, 0.45, 1}, sin_normalize(sim->text_pulse.base));
+        Vector4 color_back = {0, 0, 0, 0.7}; 
+
+        frame_text(out, pos, scale, offset, color, color_back, "WASD to move, QE to roll\nESC to exit");
+    }
+    
+    if (in->show_debug_info) {
+
+        Camera* c = &out->camera;
+        
+        char* mode = "(Unknown)";
+        switch (c->draw_mode) {
+            case GL_POINTS:         mode = "GL_POINTS";         break;
+            case GL_LINES:          mode = "GL_LINES";          break;
+            case GL_LINE_LOOP:      mode = "GL_LINE_LOOP";      break;
+            case GL_LINE_STRIP:     mode = "GL_LINE_STRIP";     break;
+            case GL_TRIANGLES:      mode = "GL_TRIANGLES";      break;
+            case GL_TRIANGLE_STRIP: mode = "GL_TRIANGLE_STRIP"; break;
+            case GL_TRIANGLE_FAN:   mode = "GL_TRIANGLE_FAN";   break;
+        }
+
+        f32 font_size   = 6 * 4 / (f32) in->height;
+        f32 line_height = 6 * 6 / (f32) in->height;
+        
+        Vector2 scale      = {font_size, font_size};
+        Vector2 offset     = {scale.x * 0.1, scale.y * -0.1};
+        Vector4 color      = V4_UNIT;
+        Vector4 color_back = {0, 0, 0, 0.7};
+        
+        // line 0 and everything under line 4 are the main thread's, see render_debug_info()
+        frame_text(out, (Vector2) {-0.95, 0.9 - line_height * 1}, scale, offset, color, color_back, "Engine   Speed: %f", engine_speed_scale);
+        frame_text(out, (Vector2) {-0.95, 0.9 - line_height * 2}, scale, offset, color, color_back, "Movement Speed: %f", movement_speed_scale);
+        frame_text(out, (Vector2) {-0.95, 0.9 - line_height * 3}, scale, offset, color, color_back, "Mesh Draw Mode: %s", mode);
+
+        f32 distance;
+        u32 hit = bvh_raycast(&sim->bvh, camera_ray(c), c->far, &distance);
+        Vector2 p = {-0.95, 0.9 - line_height * 4};
+        if (hit == BVH_NONE) frame_text(out, p, scale, offset, color, color_back, "Visible: %u/%u  Looking At: -", out->model_count, sim->scene_count);
+        else                 frame_text(out, p, scale, offset, color, color_back, "Visible: %u/%u  Looking At: %u (%fm)", out->model_count, sim->scene_count, hit, distance);
+    }
+}
+
+void simulation_thread(void* data) {
+    
+    Simulation* sim = data;
+    
+    profiler_thread("simulation");
+
+    while (1) {
+        InputFrame  in;
+        FrameState* out = pipeline_begin_state(sim->pipeline, &in);
+        profile_begin("simulate_frame");
+        if (!in.quit) simulate_frame(sim, &in, out);
+        profile_end();
+        pipeline_end_state(sim->pipeline);
+        if (in.quit) break;
+    }
+}
+
+
+
+
+/* ==== Render ==== */
+
+// main thread, frame and pass times are measured here, so their lines are drawn from here, around the simulation's lines
+void render_debug_info() {
+
+    f32 font_size   = 6 * 4 / (f32) window_info.height;
+    f32 line_height = 6 * 6 / (f32) window_info.height;
+    
+    Vector2 scale      = {font_size, font_size};
+    Vector2 offset     = {scale.x * 0.1, scale.y * -0.1};
+    Vector4 color      = V4_UNIT;
+    Vector4 color_back = {0, 0, 0, 0.7};
+
+    FrameStats*  f  = &frame_stats;
+    FrameSummary fs = frame_stats_summary(f);
+    f64 fps = fs.avg > 0 ? 1000 / fs.avg : 0;
+    
+    draw_mesh_string_shadowed((Vector2) {-0.95, 0.9}, offset, scale, color, color_back, temp_print("Frametime: %fms  FPS: %f", fs.avg, fps));
+
+    // "GPU  3D: 0.123456ms  Text: ...", one line per clock, built in place on the temp arena
+    PassTimers*   t = &pass_timers;
+    StringBuilder b;
+    builder_init(&b, temp_allocator());
+    for (u32 k = 0; k < 2; k++) {
+        f64* ms = k ? t->cpu_ms : t->gpu_ms;
+        builder_reset(&b);
+        builder_append(&b, k ? string("CPU") : string("GPU"));
+        for (u32 i = 0; i < RENDER_PASS_COUNT; i++) {
+            builder_append(&b, string("  "));
+            builder_append_c_string(&b, render_pass_names[i]);
+            builder_append(&b, string(": "));
+            builder_append_f64(&b, ms[i], 6);
+            builder_append(&b, string("ms"));
+        }
+        draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * (5 + k)}, offset, scale, color, color_back, b.base);
+    }
+    builder_free(&b);
+
+    String percentiles = temp_print("Min: %fms  P50: %fms  P95: %fms  P99: %fms  Max: %fms", fs.min, fs.p50, fs.p95, fs.p99, fs.max);
+    draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 7}, offset, scale, color, color_back, percentiles);
+    
+    String spikes;
+    if (f->spikes) spikes = temp_print("Spikes: %u  Last: %fms, %llu frames ago", f->spikes, f->last_spike_ms, f->frames - f->last_spike_frame);
+    else           spikes = string("Spikes: 0");
+    draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 8}, offset, scale, color, color_back, spikes);
+
+    RenderCounters* c = &render_counters_last;
+    String counters = temp_print(
+        "Draws: %llu  Tris: %llu  Programs: %llu  Textures: %llu  Uniforms: %llu  Upload: %lluKB", 
+        c->draw_calls, c->triangles, c->program_binds, c->texture_binds, c->uniform_uploads, c->bytes_uploaded / 1024
+    );
+    draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 9}, offset, scale, color, color_back, counters);
+
+    HeapStats heap = heap_total();
+    String heap_line = temp_print("Heap: %lluKB in %llu blocks  Allocations last frame: %llu", heap.live_bytes / 1024, heap.live_blocks, heap.last_frame_allocations);
+    draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 10}, offset, scale, color, color_back, heap_line);
+
+    // 0 to 2 frames at 60Hz, with a line at one
+    f32 h = line_height * 3;
+    draw_frame_graph(f, (Vector2) {-0.95, 0.9 - line_height * 11 - h}, (Vector2) {0.6, h}, 1000.0 / 30, 1000.0 / 60, (Vector4) {0.2, 0.8, 0.45, 0.8});
+}
+
+// main thread, only reads the state
+void render_frame(FrameState* s) {
+
+    profile_begin("render_frame");
+    begin_frame();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+
+    /* ---- 3D ---- */
+
+    pass_begin(RENDER_PASS_3D);
+    update_frame_uniforms(&s->camera, s->light, s->time, s->dt);
+    {
+        Model3D** models = temp_alloc(sizeof(Model3D*) * s->model_count);
+        for (u32 i = 0; i < s->model_count; i++) models[i] = &s->models[i];
+        draw_models(models, s->model_count, &s->camera);
+    }
+    pass_end(RENDER_PASS_3D);
+
+
+    /* ---- 2D ---- */
+
+    pass_begin(RENDER_PASS_TEXT);
+    for (u32 i = 0; i < s->text_count; i++) {
+        TextCommand* t = &s->texts[i];
+        draw_mesh_string_shadowed(t->position, t->offset, t->scale, t->color, t->shadow_color, t->text);
+    }
+
+    if (s->show_debug_info) render_debug_info();
+    pass_end(RENDER_PASS_TEXT);
+
+    pass_begin(RENDER_PASS_HUD);
+    if (s->show_debug_info) {
+        draw_axis_arrow((Vector3) {0.05, 0.05, 0.05}, &s->camera);
+    } else {
+        // cursor
+        draw_circle((Vector2) {0, 0}, (Vector2) {0.014, 0.014}, (Vector4) {0, 0, 0, 0.2});
+        draw_circle((Vector2) {0, 0}, (Vector2) {0.012, 0.012}, (Vector4) {1, 1, 1, 0.8});
+    }
+    pass_end(RENDER_PASS_HUD);
+
+    end_frame();
+    profile_counter("temp bytes", runtime.temp_buffer.allocated);
+    temp_reset();
+    profile_end();
+}
+
+
+
+
 int main(int c_arg_count, char** c_args) {
 
     setup(c_arg_count, c_args);
@@ -53,7 +335,7 @@ int main(int c_arg_count, char** c_args) {
             .scale       = {2, 2, 2},
             .orientation = {1, 0, 0, 0},
         },
-        .mesh = &gp->cube,
+        .mesh = gp->cube,
     };
  
     Model3D object2 = {
@@ -62,7 +344,7 @@ int main(int c_arg_count, char** c_args) {
             .scale       = {2, 2, 12},
             .orientation = {1, 0, 0, 0},
         },
-        .mesh = &gp->cube,
+        .mesh = gp->cube,
     };
  
     Model3D object3 = {
@@ -71,7 +353,7 @@ int main(int c_arg_count, char** c_args) {
             .scale       = {10, 10, 6},
             .orientation = {1, 0, 0, 0},
         },
-        .mesh = &gp->cube,
+        .mesh = gp->cube,
     };
     
     Model3D room[6] = {
@@ -81,7 +363,7 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {100, 100, 0.1},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
         {
             .base = {
@@ -89,7 +371,7 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {100, 100, 0.1},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
         {
             .base = {
@@ -97,7 +379,7 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {0.1, 100, 20},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
         {
             .base = {
@@ -105,7 +387,7 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {0.1, 100, 20},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
         {
             .base = {
@@ -113,7 +395,7 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {100, 0.1, 20},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
         {
             .base = {
@@ -121,136 +403,122 @@ int main(int c_arg_count, char** c_args) {
                 .scale       = {100, 0.1, 20},
                 .orientation = {1, 0, 0, 0},
             },
-            .mesh = &gp->cube,
+            .mesh = gp->cube,
         },
     };
 
 
-    Timer object_pulse = {0};
-    Timer text_pulse   = {0};
-    Timer fps_clock    = {.interval = 1};
-
-    time_now = glfwGetTime();
-
-
-    // main loop
-    while (1) {
+    // everything the BVH knows about, the index here is the item id
+    Model3D* scene[] = {
+        &room[0], &room[1], &room[2], &room[3], &room[4], &room[5],
+        &object, &object2, &object3,
+    };
+    const u32 object_id = 6;
 
+    static FramePipeline pipeline; // big, keep it off the stack
 
-        // get dt
-        f64 dt;
-        {
-            f64 next = glfwGetTime();
-            dt       = next - time_now;
-            time_now = next;
-        }
-        update_FPS_timer(&fps_clock, dt);
+    Simulation sim = {
+        .scene       = scene,
+        .scene_count = length_of(scene),
+        .object      = &object,
+        .object_id   = object_id,
+        .pipeline    = &pipeline,
+    };
 
+    {
+        AABB bounds[length_of(scene)];
+        for (u32 i = 0; i < length_of(scene); i++) bounds[i] = model_bounds(scene[i]);
+        bvh_build(&sim.bvh, bounds, length_of(scene));
+    }
 
-        /* ==== Simulate ==== */ 
-        {
-            process_inputs(dt);
-            object_pulse.base += dt * engine_speed_scale;
-            text_pulse  .base += dt * 6;
-            
-            f32 t = sin_normalize(object_pulse.base);
-            object.base.orientation = nlerp_r3d(R3D_DEFAULT, r3d_from_plane_angle(B3_XY, TAU * 0.25), t);
-            object.base.position    = lerp_v3((Vector3) {0, 0, -5}, (Vector3) {0, 0, -3}, t);
-            
-            light = (Vector3) {cos(object_pulse.base) * 20, sin(object_pulse.base) * 20, 0};
-        }
+    // state at the start of the last step, rendering lerps from here to the current state
+    Entity3D previous[length_of(scene)];
+    for (u32 i = 0; i < length_of(scene); i++) previous[i] = scene[i]->base;
+    sim.previous        = previous;
+    sim.previous_camera = camera.position;
+    sim.previous_light  = light;
 
+    pipeline_start(&pipeline, simulation_thread, &sim);
 
+    BenchResults bench = {0};
+    if (bench_options.enabled) bench_results_init(&bench, bench_options.frames, bench_options.out_path);
+    
+    u32 frame = 0;
 
-        /* ==== Render ==== */ 
+    time_now = glfwGetTime();
+    {
+        InputFrame in = next_input(frame, 0);
+        pipeline_submit_input(&pipeline, &in);
+    }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        
-        /* ---- 3D ---- */
-        
-        draw_model(room, 6, &camera);
-        draw_model(&object, 1, &camera);
-        draw_model(&object2, 1, &camera);
-        draw_model(&object3, 1, &camera);
+    // main loop, renders frame N while the simulation makes N + 1
+    while (1) {
 
+        f64 frame_start = glfwGetTime();
 
-        /* ---- 2D ---- */
+        profile_begin("frame");
 
-        {
-            Vector2 pos        = lerp_v2((Vector2) {-0.65, 0.7}, (Vector2) {-0.65, 0.72}, sin_normalize(text_pulse.base));
-            Vector2 scale      = {0.1, 0.1}; 
-            Vector2 offset     = {0.005, -0.007};
-            Vector4 color      = lerp_v4((Vector4) {0.5, 0.7, 0.95, 1}, (Vector4) {0.2, 0.8, 0.45, 1}, sin_normalize(text_pulse.base));
-            Vector4 color_back = {0, 0, 0, 0.7}; 
+        profile_begin("wait_simulation");
+        FrameState* state = pipeline_acquire_state(&pipeline);
+        profile_end();
 
-            draw_mesh_string_shadowed(pos, offset, scale, color, color_back, string("WASD to move, QE to roll\nESC to exit"));
-        }
-        
-        if (window_info.show_debug_info) {
+        if (!state->quit) {
 
-            String fps;
-            String draw_mode;
+            profile_begin("input");
+            glfwPollEvents();
+            
+            f64 dt;
             {
-                Timer* t = &fps_clock;
-                Camera* c = &camera;
-                f64 v;
-                if (t->base == 0 || t->counter == 0)  v = 60; // temp placeholder, todo: solve this better
-                else                                  v = (t->counter / t->base) / t->interval;
-                
-                char* mode = "(Unknown)";
-                switch (c->draw_mode) {
-                    case GL_POINTS:         mode = "GL_POINTS";         break;
-                    case GL_LINES:          mode = "GL_LINES";          break;
-                    case GL_LINE_LOOP:      mode = "GL_LINE_LOOP";      break;
-                    case GL_LINE_STRIP:     mode = "GL_LINE_STRIP";     break;
-                    case GL_TRIANGLES:      mode = "GL_TRIANGLES";      break;
-                    case GL_TRIANGLE_STRIP: mode = "GL_TRIANGLE_STRIP"; break;
-                    case GL_TRIANGLE_FAN:   mode = "GL_TRIANGLE_FAN";   break;
-                }
-    
-                fps       = temp_print("Frametime: %fms  FPS: %f", 1000 / v, v);
-                draw_mode = temp_print("Mesh Draw Mode: %s", mode);
-
-                if (window_info.is_first_frame) fps.count = 0;
+                f64 next = glfwGetTime();
+                dt       = next - time_now;
+                time_now = next;
             }
-            
-            f32 font_size   = 6 * 4 / (f32) window_info.height;
-            f32 line_height = 6 * 6 / (f32) window_info.height;
-            
-            Vector2 scale      = {font_size, font_size};
-            Vector2 offset     = {scale.x * 0.1, scale.y * -0.1};
-            Vector4 color      = V4_UNIT;
-            Vector4 color_back = {0, 0, 0, 0.7};
-            
-            draw_mesh_string_shadowed((Vector2) {-0.95, 0.9                  }, offset, scale, color, color_back, fps);
-            draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 1}, offset, scale, color, color_back, temp_print("Engine   Speed: %f", engine_speed_scale));
-            draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 2}, offset, scale, color, color_back, temp_print("Movement Speed: %f", movement_speed_scale));
-            draw_mesh_string_shadowed((Vector2) {-0.95, 0.9 - line_height * 3}, offset, scale, color, color_back, draw_mode);
 
-            draw_axis_arrow((Vector3) {0.05, 0.05, 0.05}, &camera);
-
-        } else {
-
-            // cursor
-            draw_circle((Vector2) {0, 0}, (Vector2) {0.014, 0.014}, (Vector4) {0, 0, 0, 0.2});
-            draw_circle((Vector2) {0, 0}, (Vector2) {0.012, 0.012}, (Vector4) {1, 1, 1, 0.8});
+            frame++;
+            frame_stats_add(&frame_stats, dt * 1000);
+            InputFrame in = next_input(frame, dt);
+            pipeline_submit_input(&pipeline, &in);
+            profile_end();
         }
 
+        render_frame(state);
 
+        u8 quit = state->quit;
+        pipeline_release_state(&pipeline);
+        if (quit) {
+            profile_end();
+            break;
+        }
 
-        /* ==== End Frame ==== */ 
+        profile_begin("swap");
+        glfwSwapBuffers(window_info.handle);
+        profile_end();
 
-        temp_reset();
+        profile_end();
+        profile_counter("draw calls", render_counters_last.draw_calls);
+        profile_counter("triangles",  render_counters_last.triangles);
         
-        if (glfwWindowShouldClose(window_info.handle)) break;
-        glfwSwapBuffers(window_info.handle);
-        glfwPollEvents();
+        u64 heap_allocations = heap_frame();
+        profile_counter("heap allocations", heap_allocations);
+        profiler_frame();
+
+        if (bench_options.enabled) bench_results_add(&bench, (glfwGetTime() - frame_start) * 1000, &render_counters_last, heap_allocations);
     }
     
-    save_position();
+    pipeline_stop(&pipeline);
+    profiler_frame();
+    profiler_report();
+
+    if (bench_options.enabled)     write_bench_results(&bench, bench_options.out_path);
+    else                           save_position();
+    if (bench_options.record_path)  save_camera_path(&camera_path, bench_options.camera_path);
+    if (bench_options.record_input) save_input_log(&input_record, bench_options.record_input);
+    if (bench_options.frame_csv)    write_frame_csv(&frame_stats, bench_options.frame_csv);
+
+    bvh_free(&sim.bvh);
+    heap_report();
     glfwTerminate(); 
 
     return 0;
 }
-
@@ -0,0 +1,296 @@
+/*
+
+==== Note ====
+
+index and vertex reordering for triangle lists, all in place, run once when a mesh is made
+
+- vertex cache: Tipsify (Sander, Nehab & Barczak 2007), linear time, greedy fanning around
+  the most recently cached vertex that still has triangles left
+- overdraw: the cache pass also splits the triangles into clusters wherever it had to jump,
+  clusters are then sorted so the ones facing outwards (likely occluders) draw first
+- vertex fetch: vertices renumbered in first use order so the vertex buffer is read linearly
+
+ACMR is average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for big grids, 3 the worst
+
+*/
+
+
+
+
+/* ==== Constants ==== */
+
+#define MESH_CACHE_SIZE 16 // FIFO post-transform cache we simulate and optimize for
+
+
+
+
+/* ==== Measure ==== */
+
+f32 mesh_acmr(u32* indices, u32 index_count, u32 vertex_count, u32 cache_size) {
+
+    if (index_count < 3) return 0;
+
+    // FIFO, store the time every vertex entered the cache
+    u32* entered = heap_alloc_zero(sizeof(u32) * vertex_count, ALLOC_OPTIMIZER);
+    u32  time    = cache_size + 1; // so nothing starts cached
+    u32  misses  = 0;
+
+    for (u32 i = 0; i < index_count; i++) {
+        u32 v = indices[i];
+        if (time - entered[v] > cache_size) {
+            entered[v] = time++;
+            misses++;
+        }
+    }
+
+    heap_free(entered);
+    return misses / (f32) (index_count / 3);
+}
+
+
+
+
+/* ==== Vertex Cache ==== */
+
+typedef struct {
+    u32* starts; // cluster start, in triangles
+    u32  count;
+} MeshClusters;
+
+// Tipsify, clusters_out is optional (freed by the caller), returns nothing else
+void optimize_vertex_cache(u32* indices, u32 index_count, u32 vertex_count, u32 cache_size, MeshClusters* clusters_out) {
+
+    u32 triangle_count = index_count / 3;
+    if (!triangle_count) return;
+
+    // vertex -> triangle adjacency, counting sort style
+    u32* live     = heap_alloc_zero(sizeof(u32) * vertex_count, ALLOC_OPTIMIZER); // triangles left per vertex
+    u32* offsets  = heap_alloc(sizeof(u32) * (vertex_count + 1), ALLOC_OPTIMIZER);
+    u32* adjacent = heap_alloc(sizeof(u32) * index_count, ALLOC_OPTIMIZER);
+
+    for (u32 i = 0; i < index_count; i++) live[indices[i]]++;
+
+    offsets[0] = 0;
+    for (u32 v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+
+    {
+        u32* fill = heap_alloc(sizeof(u32) * vertex_count, ALLOC_OPTIMIZER);
+        memcpy(fill, offsets, sizeof(u32) * vertex_count);
+        for (u32 i = 0; i < index_count; i++) adjacent[fill[indices[i]]++] = i / 3;
+        heap_free(fill);
+    }
+
+    u32* cache_time = heap_alloc_zero(sizeof(u32) * vertex_count, ALLOC_OPTIMIZER);
+    u8*  emitted    = heap_alloc_zero(sizeof(u8) * triangle_count, ALLOC_OPTIMIZER);
+    u32* dead_end   = heap_alloc(sizeof(u32) * index_count, ALLOC_OPTIMIZER);
+    u32* out        = heap_alloc(sizeof(u32) * index_count, ALLOC_OPTIMIZER);
+    u32* candidates = heap_alloc(sizeof(u32) * index_count, ALLOC_OPTIMIZER);
+
+    if (clusters_out) *clusters_out = (MeshClusters) {heap_alloc(sizeof(u32) * (triangle_count + 1), ALLOC_OPTIMIZER), 0};
+
+    u32 dead_end_count = 0;
+    u32 out_count      = 0;
+    u32 time           = cache_size + 1;
+    u32 cursor         = 1;
+    s64 f              = 0;
+
+    if (clusters_out) clusters_out->starts[clusters_out->count++] = 0;
+
+    while (f >= 0) {
+
+        u32 candidate_count = 0;
+
+        // emit every remaining triangle around f
+        for (u32 k = offsets[f]; k < offsets[f + 1]; k++) {
+
+            u32 t = adjacent[k];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+
+            for (u32 j = 0; j < 3; j++) {
+                u32 v = indices[t * 3 + j];
+                out[out_count++] = v;
+                dead_end[dead_end_count++]   = v;
+                candidates[candidate_count++] = v;
+                live[v]--;
+                if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+            }
+        }
+
+        // next fanning vertex: the candidate that stays in cache the longest, if it will still be there after its fan
+        s64 best          = -1;
+        s64 best_priority = -1;
+        for (u32 i = 0; i < candidate_count; i++) {
+            u32 v = candidates[i];
+            if (!live[v]) continue;
+            s64 priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+            if (priority > best_priority) {
+                best          = v;
+                best_priority = priority;
+            }
+        }
+
+        if (best < 0) {
+
+            // dead end: recently used vertices first, then anything left
+            while (dead_end_count) {
+                u32 v = dead_end[--dead_end_count];
+                if (live[v]) { best = v; break; }
+            }
+
+            while (best < 0 && cursor < vertex_count) {
+                if (live[cursor]) best = cursor;
+                cursor++;
+            }
+
+            // a dead end before anything was emitted (vertex 0 unused) would repeat the previous start
+            u32 start = out_count / 3;
+            if (best >= 0 && clusters_out && start < triangle_count && start != clusters_out->starts[clusters_out->count - 1]) {
+                clusters_out->starts[clusters_out->count++] = start;
+            }
+        }
+
+        f = best;
+    }
+
+    memcpy(indices, out, sizeof(u32) * out_count);
+
+    heap_free(live);
+    heap_free(offsets);
+    heap_free(adjacent);
+    heap_free(cache_time);
+    heap_free(emitted);
+    heap_free(dead_end);
+    heap_free(out);
+    heap_free(candidates);
+}
+
+
+
+
+/* ==== Overdraw ==== */
+
+typedef struct {
+    f32 key;
+    u32 start;
+    u32 count;
+} MeshClusterSort;
+
+int compare_mesh_clusters(const void* pa, const void* pb) {
+    f32 a = ((MeshClusterSort*) pa)->key;
+    f32 b = ((MeshClusterSort*) pb)->key;
+    return a > b ? -1 : a < b;
+}
+
+// position is the first 3 floats of every vertex
+void optimize_overdraw(u32* indices, u32 index_count, f32* vertices, u32 vertex_count, u64 vertex_size, MeshClusters* clusters) {
+
+    u32 stride         = vertex_size / sizeof(f32);
+    u32 triangle_count = index_count / 3;
+    if (clusters->count < 2) return;
+
+    Vector3 mesh_center = {0};
+    for (u32 v = 0; v < vertex_count; v++) mesh_center = v3_add(mesh_center, *(Vector3*) (vertices + v * stride));
+    mesh_center = v3_scale(mesh_center, 1.0 / vertex_count);
+
+    MeshClusterSort* sorted = heap_alloc(sizeof(MeshClusterSort) * clusters->count, ALLOC_OPTIMIZER);
+
+    for (u32 c = 0; c < clusters->count; c++) {
+
+        u32 start = clusters->starts[c];
+        u32 end   = c + 1 < clusters->count ? clusters->starts[c + 1] : triangle_count;
+
+        // area weighted normal and centroid
+        Vector3 normal   = {0};
+        Vector3 centroid = {0};
+        f32     area     = 0;
+
+        for (u32 t = start; t < end; t++) {
+            Vector3 p0 = *(Vector3*) (vertices + indices[t * 3 + 0] * stride);
+            Vector3 p1 = *(Vector3*) (vertices + indices[t * 3 + 1] * stride);
+            Vector3 p2 = *(Vector3*) (vertices + indices[t * 3 + 2] * stride);
+
+            BiVector3 b = v3_wedge(v3_sub(p1, p0), v3_sub(p2, p0));
+            Vector3   n = {b.yz, b.zx, b.xy}; // dual of the wedge is the cross product
+            f32       a = v3_length(n);
+
+            normal   = v3_add(normal, n);
+            centroid = v3_add(centroid, v3_scale(v3_add(v3_add(p0, p1), p2), a / 3));
+            area    += a;
+        }
+
+        if (area > 0) centroid = v3_scale(centroid, 1 / area);
+
+        f32 length = v3_length(normal);
+        f32 key    = length > 0 ? v3_dot(v3_sub(centroid, mesh_center), v3_scale(normal, 1 / length)) : 0;
+
+        sorted[c] = (MeshClusterSort) {key, start, end - start};
+    }
+
+    qsort(sorted, clusters->count, sizeof(MeshClusterSort), compare_mesh_clusters);
+
+    u32* out = heap_alloc(sizeof(u32) * index_count, ALLOC_OPTIMIZER);
+    u32  acc = 0;
+    for (u32 c = 0; c < clusters->count; c++) {
+        memcpy(out + acc, indices + sorted[c].start * 3, sizeof(u32) * sorted[c].count * 3);
+        acc += sorted[c].count * 3;
+    }
+    memcpy(indices, out, sizeof(u32) * acc);
+
+    heap_free(out);
+    heap_free(sorted);
+}
+
+
+
+
+/* ==== Vertex Fetch ==== */
+
+// renumber vertices in the order the indices first touch them, unused vertices go to the end
+void optimize_vertex_fetch(f32* vertices, u32* indices, u32 vertex_count, u32 index_count, u64 vertex_size) {
+
+    u32* remap = heap_alloc(sizeof(u32) * vertex_count, ALLOC_OPTIMIZER);
+    memset(remap, 0xff, sizeof(u32) * vertex_count);
+
+    u32 next = 0;
+    for (u32 i = 0; i < index_count; i++) {
+        u32 v = indices[i];
+        if (remap[v] == 0xffffffff) remap[v] = next++;
+        indices[i] = remap[v];
+    }
+    for (u32 v = 0; v < vertex_count; v++) {
+        if (remap[v] == 0xffffffff) remap[v] = next++;
+    }
+
+    u8* copy = heap_alloc(vertex_size * vertex_count, ALLOC_OPTIMIZER);
+    memcpy(copy, vertices, vertex_size * vertex_count);
+    for (u32 v = 0; v < vertex_count; v++) {
+        memcpy((u8*) vertices + remap[v] * vertex_size, copy + v * vertex_size, vertex_size);
+    }
+
+    heap_free(copy);
+    heap_free(remap);
+}
+
+
+
+
+/* ==== All ==== */
+
+// triangle lists only, name is only for the log
+void optimize_mesh(char* name, f32* vertices, u32* indices, u32 vertex_count, u32 index_count, u64 vertex_size, u8 overdraw) {
+
+    f32 before = mesh_acmr(indices, index_count, vertex_count, MESH_CACHE_SIZE);
+
+    MeshClusters clusters;
+    optimize_vertex_cache(indices, index_count, vertex_count, MESH_CACHE_SIZE, overdraw ? &clusters : NULL);
+    if (overdraw) {
+        optimize_overdraw(indices, index_count, vertices, vertex_count, vertex_size, &clusters);
+        heap_free(clusters.starts);
+    }
+    optimize_vertex_fetch(vertices, indices, vertex_count, index_count, vertex_size);
+
+    f32 after = mesh_acmr(indices, index_count, vertex_count, MESH_CACHE_SIZE);
+    logprint("[Mesh] %s: ACMR %f -> %f (%u triangles)\n", name, before, after, index_count / 3);
+}
@@ -13,6 +13,13 @@ typedef struct {           \
     u64   count;           \
 } Array(Type)              \
 
+// a Handle that only converts to and from its own type, see Pool
+#define Handle(Type) Handle_ ## Type
+#define Define_Handle(Type) \
+typedef struct {            \
+    Handle h;               \
+} Handle(Type)              \
+
 
 
 
@@ -35,9 +42,9 @@ typedef struct {
 } String;
 
 typedef struct {
-    String base;
-    u64    allocated;
-} StringBuilder;
+    u32 index;      // slot
+    u32 generation; // of the slot when it was handed out, 0 is never valid, so {0} is the null handle
+} Handle;
 
 Define_Array(String);
 
@@ -69,10 +76,8 @@ struct {
     FILE*         log_file;
 } runtime;
 
-void* temp_alloc(u64 count) {
+void* arena_alloc(ArenaBuffer* a, u64 count) {
 
-    ArenaBuffer* a = &runtime.temp_buffer;
-    
     u64 current = a->allocated;
     u64 wanted  = current + count;
     
@@ -84,6 +89,10 @@ void* temp_alloc(u64 count) {
     return a->data + current;
 }
 
+void* temp_alloc(u64 count) {
+    return arena_alloc(&runtime.temp_buffer, count);
+}
+
 void temp_free(u64 size) {
     runtime.temp_buffer.allocated -= size;
 }
@@ -131,58 +140,1214 @@ void error(char* s, ...) {
 
 
 
-/* ==== Timer ==== */
+/* ==== Heap ==== */
+
+/*
+    every heap allocation goes through here with a tag, so we know per tag what is live, the peak,
+    and how many allocations each frame made (steady state should be 0, anything else is a bug to kill).
+    a 16 byte header in front of every block keeps the size and tag, so malloc's alignment stays,
+    only heap_free() may free these, never free().
+    the counters are atomic, the simulation thread allocates too
+*/
+
+typedef enum {
+    ALLOC_DEFAULT, // runtime.alloc, file contents
+    ALLOC_RUNTIME,
+    ALLOC_STRING,
+    ALLOC_MESH,
+    ALLOC_BVH,
+    ALLOC_OPTIMIZER,
+    ALLOC_THREAD,
+    ALLOC_POOL,
+    ALLOC_DEBUG,   // profiler, benchmark, logs and recordings
+    ALLOC_TAG_COUNT,
+} AllocTag;
+
+char* alloc_tag_names[ALLOC_TAG_COUNT] = {"default", "runtime", "string", "mesh", "bvh", "optimizer", "thread", "pool", "debug"};
+
+#define HEAP_MAGIC 0x48454150 // "HEAP"
 
 typedef struct {
-    struct timespec start;
-    struct timespec end;
-    u8 which;
-} PerformanceTimer;
+    u64 size;
+    u32 tag;
+    u32 magic;
+} HeapHeader;
+
+typedef struct {
+    u64 live_bytes;
+    u64 peak_bytes;
+    u64 live_blocks;
+    u64 allocations; // reallocs count too
+    u64 frees;
+    u64 frame_allocations;
+    u64 last_frame_allocations;
+} HeapStats;
+
+HeapStats heap_stats[ALLOC_TAG_COUNT];
 
-PerformanceTimer timer;
+void heap_count(u32 tag, s64 bytes, s64 blocks) {
 
-void time_it() {
-    if (timer.which == 0) {
-        clock_gettime(CLOCK_MONOTONIC, &timer.start);
-        timer.which = 1;
+    HeapStats* s = &heap_stats[tag];
+    
+    u64 live = __atomic_add_fetch(&s->live_bytes, bytes, __ATOMIC_RELAXED);
+    u64 peak = __atomic_load_n(&s->peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&s->peak_bytes, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+    __atomic_add_fetch(&s->live_blocks, blocks, __ATOMIC_RELAXED);
+    
+    if (blocks < 0) {
+        __atomic_add_fetch(&s->frees, 1, __ATOMIC_RELAXED);
     } else {
-        clock_gettime(CLOCK_MONOTONIC, &timer.end);
-        printf("%fs\n", (timer.end.tv_sec - timer.start.tv_sec) + 1e-9 * (timer.end.tv_nsec - timer.start.tv_nsec));
-        timer.which = 0;
+        __atomic_add_fetch(&s->allocations,       1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s->frame_allocations, 1, __ATOMIC_RELAXED);
     }
 }
 
+void* heap_alloc(u64 size, AllocTag tag) {
+    HeapHeader* h = malloc(sizeof(HeapHeader) + size);
+    if (!h) error("[Heap] Out of memory, %llu bytes for %s\n", size, alloc_tag_names[tag]);
+    *h = (HeapHeader) {size, tag, HEAP_MAGIC};
+    heap_count(tag, size, 1);
+    return h + 1;
+}
 
+void* heap_alloc_zero(u64 size, AllocTag tag) {
+    void* p = heap_alloc(size, tag);
+    memset(p, 0, size);
+    return p;
+}
 
+// keeps the tag the block was made with
+void* heap_realloc(void* p, u64 size, AllocTag tag) {
+    
+    if (!p) return heap_alloc(size, tag);
 
+    HeapHeader* h = (HeapHeader*) p - 1;
+    assert(h->magic == HEAP_MAGIC);
+    
+    u64 old = h->size;
+    tag     = h->tag;
+    
+    h = realloc(h, sizeof(HeapHeader) + size);
+    if (!h) error("[Heap] Out of memory, %llu bytes for %s\n", size, alloc_tag_names[tag]);
+    h->size = size;
+    heap_count(tag, (s64) size - (s64) old, 0);
+    return h + 1;
+}
 
-/* ==== StringBuilder: Basic ==== */
+void heap_free(void* p) {
+    
+    if (!p) return;
+    
+    HeapHeader* h = (HeapHeader*) p - 1;
+    assert(h->magic == HEAP_MAGIC);
+    h->magic = 0; // a second free asserts
+
+    heap_count(h->tag, -(s64) h->size, -1);
+    free(h);
+}
+
+// for runtime.alloc
+void* default_alloc(u64 size) {
+    return heap_alloc(size, ALLOC_DEFAULT);
+}
+
+// main thread, once per frame, returns the allocations the last frame made over all tags
+u64 heap_frame() {
+    u64 total = 0;
+    for (u32 i = 0; i < ALLOC_TAG_COUNT; i++) {
+        HeapStats* s = &heap_stats[i];
+        s->last_frame_allocations = __atomic_exchange_n(&s->frame_allocations, 0, __ATOMIC_RELAXED);
+        total += s->last_frame_allocations;
+    }
+    return total;
+}
+
+HeapStats heap_total() {
+    HeapStats t = {0};
+    for (u32 i = 0; i < ALLOC_TAG_COUNT; i++) {
+        HeapStats* s = &heap_stats[i];
+        t.live_bytes             += s->live_bytes;
+        t.live_blocks            += s->live_blocks;
+        t.peak_bytes             += s->peak_bytes; // sum of the peaks, not the peak of the sum
+        t.allocations            += s->allocations;
+        t.frees                  += s->frees;
+        t.last_frame_allocations += s->last_frame_allocations;
+    }
+    return t;
+}
+
+// at exit, whatever is still live is either a leak or something we never bother to free
+void heap_report() {
+    logprint("[Heap] %-10s %12s %12s %10s %10s %8s\n", "tag", "live", "peak", "allocs", "frees", "blocks");
+    for (u32 i = 0; i < ALLOC_TAG_COUNT; i++) {
+        HeapStats* s = &heap_stats[i];
+        if (!s->allocations) continue;
+        logprint(
+            "[Heap] %-10s %12llu %12llu %10llu %10llu %8llu\n", 
+            alloc_tag_names[i], s->live_bytes, s->peak_bytes, s->allocations, s->frees, s->live_blocks
+        );
+    }
+}
+
+
+
+
+/* ==== Allocator ==== */
+
+/*
+    one proc does everything: p NULL allocates, new_size 0 frees, anything else resizes (old_size bytes are kept).
+    arenas only grow or give back the last allocation, anything older stays until the arena resets.
+    the temp arena is the main thread's only
+*/
+
+typedef void* (*AllocatorProc)(void* data, void* p, u64 old_size, u64 new_size);
+
+typedef struct {
+    AllocatorProc proc;
+    void*         data;
+} Allocator;
+
+void* arena_allocator_proc(void* data, void* p, u64 old_size, u64 new_size) {
+
+    ArenaBuffer* a    = data;
+    u8          last = p && (u8*) p + old_size == a->data + a->allocated;
+    
+    if (!new_size) {
+        if (last) a->allocated -= old_size;
+        return NULL;
+    }
+
+    if (last) {
+        a->allocated -= old_size;
+        return arena_alloc(a, new_size); // same p, in place
+    }
+
+    void* out = arena_alloc(a, new_size);
+    if (p) memcpy(out, p, old_size < new_size ? old_size : new_size);
+    return out;
+}
+
+void* heap_allocator_proc(void* data, void* p, u64 old_size, u64 new_size) {
+    if (!new_size) {
+        heap_free(p);
+        return NULL;
+    }
+    return heap_realloc(p, new_size, (AllocTag) (u64) data);
+}
 
-// todo: can only use heap allocator now, how to change allocator?
-StringBuilder builder_init() {
-    return (StringBuilder) {
-        .base.data  = malloc(1024),
-        .base.count = 0,
-        .allocated  = 1024,
+Allocator arena_allocator(ArenaBuffer* a) {
+    return (Allocator) {arena_allocator_proc, a};
+}
+
+Allocator temp_allocator() {
+    return arena_allocator(&runtime.temp_buffer);
+}
+
+Allocator heap_allocator(AllocTag tag) {
+    return (Allocator) {heap_allocator_proc, (void*) (u64) tag};
+}
+
+void* allocator_alloc(Allocator a, u64 size) {
+    return a.proc(a.data, NULL, 0, size);
+}
+
+void* allocator_resize(Allocator a, void* p, u64 old_size, u64 new_size) {
+    return a.proc(a.data, p, old_size, new_size);
+}
+
+void allocator_free(Allocator a, void* p, u64 size) {
+    if (p) a.proc(a.data, p, size, 0);
+}
+
+
+
+
+/* ==== Pool ==== */
+
+/*
+    fixed size objects in one fixed block, O(1) add and remove, handles instead of pointers
+
+    every slot has a generation, odd while it is live, a handle remembers the generation it was made with,
+    so after a remove (and any reuse of the slot) old handles get NULL from pool_get() instead of someone else's object.
+    slots never move, a pointer from pool_get() is good until that object is removed.
+    iterate with pool_at() over [0, used), free slots give NULL.
+    not thread safe, the engine only adds and removes at load time
+*/
+
+typedef struct {
+    u8*  items;       // item_size * capacity
+    u32* generations; // per slot
+    u32* free_slots;  // stack
+    u32  free_count;
+    u32  item_size;
+    u32  capacity;
+    u32  count;       // live
+    u32  used;        // slots ever handed out
+} Pool;
+
+void pool_init(Pool* p, u32 item_size, u32 capacity) {
+    *p = (Pool) {
+        .items       = heap_alloc(item_size * capacity, ALLOC_POOL),
+        .generations = heap_alloc_zero(sizeof(u32) * capacity, ALLOC_POOL),
+        .free_slots  = heap_alloc(sizeof(u32) * capacity, ALLOC_POOL),
+        .item_size   = item_size,
+        .capacity    = capacity,
     };
 }
 
+void pool_free(Pool* p) {
+    heap_free(p->items);
+    heap_free(p->generations);
+    heap_free(p->free_slots);
+    *p = (Pool) {0};
+}
+
+// the new object is zeroed
+Handle pool_add(Pool* p) {
+    
+    u32 slot = 0;
+    if      (p->free_count)         slot = p->free_slots[--p->free_count];
+    else if (p->used < p->capacity) slot = p->used++;
+    else                            error("[Pool] Full, %u objects of %u bytes\n", p->capacity, p->item_size);
+
+    p->generations[slot]++;
+    p->count++;
+    memset(p->items + (u64) slot * p->item_size, 0, p->item_size);
+
+    return (Handle) {slot, p->generations[slot]};
+}
+
+void* pool_get(Pool* p, Handle h) {
+    if (h.index >= p->used || !(h.generation & 1) || p->generations[h.index] != h.generation) return NULL;
+    return p->items + (u64) h.index * p->item_size;
+}
+
+// NULL for a free slot
+void* pool_at(Pool* p, u32 slot) {
+    if (slot >= p->used || !(p->generations[slot] & 1)) return NULL;
+    return p->items + (u64) slot * p->item_size;
+}
+
+// returns 0 for a stale handle, removing twice is harmless
+u8 pool_remove(Pool* p, Handle h) {
+    if (!pool_get(p, h)) return 0;
+    p->generations[h.index]++;
+    p->free_slots[p->free_count++] = h.index;
+    p->count--;
+    return 1;
+}
+
+
+
+
+/* ==== Threads ==== */
+
+// the OS handles, the win32 layer on Windows, pthreads otherwise
+typedef struct {
+    void* handle;
+} Thread;
+
+typedef struct {
+    void* handle;
+} Semaphore;
+
+#ifdef OS_WINDOWS
+
+Thread thread_start(void (*proc)(void*), void* data) {
+    Thread t = {win32_thread_start(proc, data)};
+    if (!t.handle) error("[Thread] Cannot start thread\n");
+    return t;
+}
+
+void thread_join(Thread t) {
+    win32_thread_join(t.handle);
+}
+
+Semaphore semaphore_create(u32 initial) {
+    Semaphore s = {win32_semaphore_create(initial)};
+    if (!s.handle) error("[Thread] Cannot create semaphore\n");
+    return s;
+}
+
+void semaphore_wait(Semaphore s) {
+    win32_semaphore_wait(s.handle);
+}
+
+void semaphore_signal(Semaphore s) {
+    win32_semaphore_signal(s.handle);
+}
+
+void semaphore_destroy(Semaphore s) {
+    win32_semaphore_destroy(s.handle);
+}
+
+#else
+
+typedef struct {
+    void (*proc)(void*);
+    void* data;
+} ThreadStart;
+
+void* thread_trampoline(void* p) {
+    ThreadStart start = *(ThreadStart*) p;
+    heap_free(p);
+    start.proc(start.data);
+    return NULL;
+}
+
+Thread thread_start(void (*proc)(void*), void* data) {
+    
+    pthread_t*   t     = heap_alloc(sizeof(pthread_t), ALLOC_THREAD);
+    ThreadStart* start = heap_alloc(sizeof(ThreadStart), ALLOC_THREAD);
+    *start = (ThreadStart) {proc, data};
+    
+    if (pthread_create(t, NULL, thread_trampoline, start)) error("[Thread] Cannot start thread\n");
+    return (Thread) {t};
+}
+
+void thread_join(Thread t) {
+    pthread_join(*(pthread_t*) t.handle, NULL);
+    heap_free(t.handle);
+}
+
+Semaphore semaphore_create(u32 initial) {
+    sem_t* s = heap_alloc(sizeof(sem_t), ALLOC_THREAD);
+    if (sem_init(s, 0, initial)) error("[Thread] Cannot create semaphore\n");
+    return (Semaphore) {s};
+}
+
+void semaphore_wait(Semaphore s) {
+    while (sem_wait(s.handle)) {} // only fails on signal interrupts, try again
+}
+
+void semaphore_signal(Semaphore s) {
+    sem_post(s.handle);
+}
+
+void semaphore_destroy(Semaphore s) {
+    sem_destroy(s.handle);
+    heap_free(s.handle);
+}
+
+#endif
+
+
+
+
+/* ==== Clock ==== */
+
+// a monotonic tick count, QueryPerformanceCounter through the win32 layer on Windows, clock_gettime otherwise
+#ifdef OS_WINDOWS
+
+u64 clock_ticks() {
+    return win32_timer_ticks();
+}
+
+u64 clock_frequency() {
+    return win32_timer_frequency();
+}
+
+#else
+
+u64 clock_ticks() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+u64 clock_frequency() {
+    return 1000000000ull;
+}
+
+#endif
+
+
+
+
+/* ==== Profiler ==== */
+
+/*
+    nestable CPU zones, compiled out entirely unless PROFILER is defined (see build.sh)
+
+        profile_begin("draw_model");
+        ...
+        profile_end();
+
+    a thread calls profiler_thread("name") once before its first zone, then every begin and end is one 16 byte
+    event pushed to that thread's own ring, no locks, no allocation, the main thread is the only reader.
+    profiler_frame() (main thread, once per frame) drains every ring into a call tree per thread
+    and keeps the numbers of the last frame plus the totals, profiler_report() logs them
+
+    if a ring fills up (the main thread stopped draining) events are dropped and counted, 
+    the tree of that thread is not trustworthy after that
+
+    profiler_capture(path, frames) also keeps every event of the next frames (PROFILER_CAPTURE_ALL: until exit)
+    and writes them as Chrome Trace Event JSON, for chrome://tracing or ui.perfetto.dev,
+    with thread names, a marker at the end of every frame and whatever profile_counter() got (main thread only)
+*/
+
+#define PROFILER_CAPTURE_ALL 0xffffffff
+
+#ifdef PROFILER
+
+#define PROFILER_MAX_THREADS 4
+#define PROFILER_RING_SIZE   (1 << 16) // events per thread, power of 2
+#define PROFILER_MAX_NODES   256       // distinct call paths per thread
+#define PROFILER_MAX_DEPTH   32
+#define PROFILER_NONE        0xffffffff
+
+typedef struct {
+    u64   ticks;
+    char* name; // NULL for an end
+} ProfileEvent;
+
+typedef struct {
+    char* name;
+    u32   parent;
+    u64   ticks;       // current frame so far
+    u32   calls;
+    u64   last_ticks;  // last finished frame
+    u32   last_calls;
+    u64   total_ticks;
+    u64   total_calls;
+} ProfileNode;
+
+typedef struct {
+
+    // producer, only the owning thread writes these
+    ProfileEvent events[PROFILER_RING_SIZE];
+    u64          write;
+    u64          dropped;
+    
+    // consumer, only the main thread
+    u64          read;
+    char*        name;
+    ProfileNode  nodes[PROFILER_MAX_NODES];
+    u32          node_count;
+    u32          stack[PROFILER_MAX_DEPTH]; // open zones
+    u64          starts[PROFILER_MAX_DEPTH];
+    u32          depth;
+    u32          too_deep;  // begins past PROFILER_MAX_DEPTH, their ends are skipped
+
+} ProfileThread;
+
+typedef enum {
+    PROFILE_CAPTURE_BEGIN,
+    PROFILE_CAPTURE_END,
+    PROFILE_CAPTURE_COUNTER,
+    PROFILE_CAPTURE_FRAME,
+} ProfileCaptureKind;
+
+typedef struct {
+    u64   ticks;
+    char* name;
+    f64   value;  // counters only
+    u32   thread;
+    u32   kind;
+} ProfileCaptureEvent;
+
+typedef struct {
+    ProfileCaptureEvent* events;
+    u64                  count;
+    u64                  allocated;
+    u64                  start;
+    u32                  frames_left; // 0 when not capturing
+    u32                  depth[PROFILER_MAX_THREADS]; // so ends of zones opened before the capture are skipped
+    char*                path;
+} ProfileCapture;
+
+struct {
+    ProfileThread  threads[PROFILER_MAX_THREADS];
+    u32            thread_count;
+    f64            ticks_per_second;
+    u64            frames;
+    ProfileCapture capture; // main thread
+} profiler;
+
+static __thread ProfileThread* profiler_local;
+
+static inline u64 profiler_ticks() {
+    #if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+    #else
+    return clock_ticks();
+    #endif
+}
+
+static inline void profile_event(char* name) {
+
+    ProfileThread* t = profiler_local;
+    if (!t) return;
+
+    u64 w = t->write;
+    if (w - __atomic_load_n(&t->read, __ATOMIC_ACQUIRE) == PROFILER_RING_SIZE) {
+        t->dropped++;
+        return;
+    }
+    
+    t->events[w & (PROFILER_RING_SIZE - 1)] = (ProfileEvent) {profiler_ticks(), name};
+    __atomic_store_n(&t->write, w + 1, __ATOMIC_RELEASE);
+}
+
+#define profile_begin(name) profile_event(name)
+#define profile_end()       profile_event(NULL)
+
+// measures the tick rate against the platform clock for 10ms
+void profiler_init() {
+    
+    f64 frequency = clock_frequency();
+    u64 a         = clock_ticks();
+    u64 start     = profiler_ticks();
+    
+    f64 elapsed;
+    do {
+        elapsed = (clock_ticks() - a) / frequency;
+    } while (elapsed < 0.01);
+    
+    profiler.ticks_per_second = (profiler_ticks() - start) / elapsed;
+}
+
+void profiler_thread(char* name) {
+    u32 i = __atomic_load_n(&profiler.thread_count, __ATOMIC_ACQUIRE);
+    if (i == PROFILER_MAX_THREADS) error("[Profiler] Too many threads, raise PROFILER_MAX_THREADS\n");
+    profiler.threads[i].name = name;
+    profiler_local = &profiler.threads[i];
+    __atomic_store_n(&profiler.thread_count, i + 1, __ATOMIC_RELEASE);
+}
+
+f64 profiler_ms(u64 ticks) {
+    return ticks * 1000.0 / profiler.ticks_per_second;
+}
+
+// same name under the same parent is the same node, names are usually literals so the pointer check hits first
+u32 profiler_node(ProfileThread* t, u32 parent, char* name) {
+    
+    for (u32 i = 0; i < t->node_count; i++) {
+        ProfileNode* n = &t->nodes[i];
+        if (n->parent == parent && (n->name == name || !strcmp(n->name, name))) return i;
+    }
+
+    if (t->node_count == PROFILER_MAX_NODES) return PROFILER_NONE;
+    
+    t->nodes[t->node_count] = (ProfileNode) {.name = name, .parent = parent};
+    return t->node_count++;
+}
+
+/* ---- Capture ---- */
+
+void profiler_capture(char* path, u32 frames) {
+    
+    ProfileCapture* c = &profiler.capture;
+    if (c->frames_left) {
+        logprint("[Profiler] Already capturing to %s\n", c->path);
+        return;
+    }
+    
+    c->count       = 0;
+    c->start       = profiler_ticks();
+    c->frames_left = frames;
+    c->path        = path;
+    memset(c->depth, 0, sizeof(c->depth));
+
+    if (frames == PROFILER_CAPTURE_ALL) logprint("[Profiler] Capturing until exit to %s\n", path);
+    else                                logprint("[Profiler] Capturing %u frames to %s\n", frames, path);
+}
+
+void profiler_capture_push(u64 ticks, char* name, f64 value, u32 thread, u32 kind) {
+    ProfileCapture* c = &profiler.capture;
+    if (c->count == c->allocated) {
+        c->allocated = c->allocated ? c->allocated * 2 : 1024 * 16;
+        c->events    = heap_realloc(c->events, sizeof(ProfileCaptureEvent) * c->allocated, ALLOC_DEBUG);
+    }
+    c->events[c->count++] = (ProfileCaptureEvent) {ticks, name, value, thread, kind};
+}
+
+// main thread
+void profile_counter(char* name, f64 value) {
+    if (!profiler.capture.frames_left) return;
+    profiler_capture_push(profiler_ticks(), name, value, 0, PROFILE_CAPTURE_COUNTER);
+}
+
+// names are not escaped, they are all literals in the source
+void profiler_write_trace() {
+
+    ProfileCapture* c = &profiler.capture;
+    
+    FILE* f = fopen(c->path, "wb");
+    if (!f) {
+        logprint("[Profiler] Cannot write %s\n", c->path);
+        c->frames_left = 0;
+        return;
+    }
+
+    f64 us = 1e6 / profiler.ticks_per_second;
+    u32 count = __atomic_load_n(&profiler.thread_count, __ATOMIC_ACQUIRE);
+    
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"Engine\"}}");
+    for (u32 i = 0; i < count; i++) {
+        fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}", i, profiler.threads[i].name);
+    }
+    
+    for (u64 i = 0; i < c->count; i++) {
+        
+        ProfileCaptureEvent* e = &c->events[i];
+        f64 ts = (s64) (e->ticks - c->start) * us;
+        
+        switch (e->kind) {
+            case PROFILE_CAPTURE_BEGIN:   fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}", e->name, ts, e->thread); break;
+            case PROFILE_CAPTURE_END:     fprintf(f, ",\n{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}", ts, e->thread); break;
+            case PROFILE_CAPTURE_COUNTER: fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": {\"value\": %g}}", e->name, ts, e->value); break;
+            case PROFILE_CAPTURE_FRAME:   fprintf(f, ",\n{\"name\": \"frame %llu\", \"ph\": \"i\", \"s\": \"g\", \"ts\": %.3f, \"pid\": 1, \"tid\": 0}", (u64) e->value, ts); break;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    
+    logprint("[Profiler] Wrote %llu events to %s\n", c->count, c->path);
+    c->frames_left = 0;
+}
+
+void profiler_drain(ProfileThread* t, u32 thread) {
+
+    ProfileCapture* c = &profiler.capture;
+
+    u64 r = t->read;
+    u64 w = __atomic_load_n(&t->write, __ATOMIC_ACQUIRE);
+
+    for (; r < w; r++) {
+        
+        ProfileEvent e = t->events[r & (PROFILER_RING_SIZE - 1)];
+        
+        if (e.name) {
+            if (t->depth == PROFILER_MAX_DEPTH) { t->too_deep++; continue; }
+            u32 parent = t->depth ? t->stack[t->depth - 1] : PROFILER_NONE;
+            t->stack [t->depth] = parent == PROFILER_NONE && t->depth ? PROFILER_NONE : profiler_node(t, parent, e.name);
+            t->starts[t->depth] = e.ticks;
+            t->depth++;
+            if (c->frames_left && e.ticks >= c->start) {
+                profiler_capture_push(e.ticks, e.name, 0, thread, PROFILE_CAPTURE_BEGIN);
+                c->depth[thread]++;
+            }
+        } else {
+            if (t->too_deep) { t->too_deep--; continue; }
+            if (!t->depth) continue;
+            t->depth--;
+            if (c->frames_left && c->depth[thread]) {
+                profiler_capture_push(e.ticks, NULL, 0, thread, PROFILE_CAPTURE_END);
+                c->depth[thread]--;
+            }
+            u32 n = t->stack[t->depth];
+            if (n == PROFILER_NONE) continue;
+            t->nodes[n].ticks += e.ticks - t->starts[t->depth];
+            t->nodes[n].calls++;
+        }
+    }
+
+    __atomic_store_n(&t->read, r, __ATOMIC_RELEASE);
+}
+
+// main thread, zones still open are counted in the frame they end in
+void profiler_frame() {
+    
+    u32 count = __atomic_load_n(&profiler.thread_count, __ATOMIC_ACQUIRE);
+    
+    for (u32 i = 0; i < count; i++) {
+        
+        ProfileThread* t = &profiler.threads[i];
+        profiler_drain(t, i);
+        
+        for (u32 j = 0; j < t->node_count; j++) {
+            ProfileNode* n = &t->nodes[j];
+            n->last_ticks   = n->ticks;
+            n->last_calls   = n->calls;
+            n->total_ticks += n->ticks;
+            n->total_calls += n->calls;
+            n->ticks = 0;
+            n->calls = 0;
+        }
+    }
+
+    ProfileCapture* c = &profiler.capture;
+    if (c->frames_left) {
+        profiler_capture_push(profiler_ticks(), NULL, profiler.frames, 0, PROFILE_CAPTURE_FRAME);
+        if (c->frames_left != PROFILER_CAPTURE_ALL && !--c->frames_left) {
+            profiler_write_trace();
+        }
+    }
+
+    profiler.frames++;
+}
+
+void profiler_report_children(ProfileThread* t, u32 parent, u32 depth) {
+    
+    f64 frames = profiler.frames ? profiler.frames : 1;
+    
+    for (u32 i = 0; i < t->node_count; i++) {
+        ProfileNode* n = &t->nodes[i];
+        if (n->parent != parent) continue;
+        logprint(
+            "[Profiler] %*s%-*s avg %8.3fms  last %8.3fms  calls/frame %8.2f\n", 
+            depth * 2, "", 32 - depth * 2, n->name, 
+            profiler_ms(n->total_ticks) / frames, profiler_ms(n->last_ticks), n->total_calls / frames
+        );
+        profiler_report_children(t, i, depth + 1);
+    }
+}
+
+// also finishes a capture that is still running
+void profiler_report() {
+    
+    if (profiler.capture.frames_left) profiler_write_trace();
+
+    u32 count = __atomic_load_n(&profiler.thread_count, __ATOMIC_ACQUIRE);
+    
+    logprint("[Profiler] %llu frames, %.0f MHz ticks\n", profiler.frames, profiler.ticks_per_second / 1e6);
+    for (u32 i = 0; i < count; i++) {
+        ProfileThread* t = &profiler.threads[i];
+        logprint("[Profiler] Thread \"%s\"", t->name);
+        if (t->dropped) logprint(", %llu events dropped", t->dropped);
+        logprint("\n");
+        profiler_report_children(t, PROFILER_NONE, 1);
+    }
+}
+
+#else
+
+#define profiler_init()
+#define profiler_thread(name)
+#define profile_begin(name)
+#define profile_end()
+#define profiler_frame()
+#define profiler_report()
+#define profile_counter(name, value)
+#define profiler_capture(path, frames) logprint("[Profiler] Built without PROFILER, nothing to capture\n")
+
+#endif
+
+
+
+
+
+/* ==== StringBuilder: Basic ==== */
+
+#define BUILDER_SMALL_SIZE 128 // most lines we build fit, so those never touch the allocator
+
+// base.data points into small until the first growth, so don't copy a builder that is in use
+typedef struct {
+    String    base;
+    u64       allocated;
+    Allocator allocator;
+    u8        small[BUILDER_SMALL_SIZE];
+} StringBuilder;
+
+void builder_init(StringBuilder* b, Allocator allocator) {
+    b->base      = (String) {b->small, 0};
+    b->allocated = BUILDER_SMALL_SIZE;
+    b->allocator = allocator;
+}
+
+// no allocator, writes past size are cut off
+void builder_init_fixed(StringBuilder* b, u8* data, u64 size) {
+    b->base      = (String) {data, 0};
+    b->allocated = size;
+    b->allocator = (Allocator) {0};
+}
+
 void builder_free(StringBuilder* b) {
-    free(b->base.data);
+    if (b->base.data != b->small && b->allocator.proc) allocator_free(b->allocator, b->base.data, b->allocated);
+    b->base      = (String) {b->small, 0};
+    b->allocated = BUILDER_SMALL_SIZE;
+}
+
+void builder_reset(StringBuilder* b) {
+    b->base.count = 0;
+}
+
+// make room for count more bytes, grows by doubling, returns how many fit (less than count only for fixed builders)
+u64 builder_reserve(StringBuilder* b, u64 count) {
+    
+    u64 wanted = b->base.count + count;
+    if (wanted <= b->allocated) return count;
+    if (!b->allocator.proc)     return b->allocated - b->base.count;
+
+    u64 size = b->allocated * 2;
+    while (size < wanted) size *= 2;
+
+    if (b->base.data == b->small) {
+        u8* data = allocator_alloc(b->allocator, size);
+        memcpy(data, b->small, b->base.count);
+        b->base.data = data;
+    } else {
+        b->base.data = allocator_resize(b->allocator, b->base.data, b->allocated, size);
+    }
+    b->allocated = size;
+
+    return count;
 }
 
 u64 builder_append(StringBuilder* b, String s) {
+    u64 count = builder_reserve(b, s.count);
+    memcpy(b->base.data + b->base.count, s.data, count);
+    b->base.count += count;
+    return count;
+}
+
+u64 builder_append_c_string(StringBuilder* b, char* s) {
+    return builder_append(b, (String) {(u8*) s, strlen(s)});
+}
+
+u64 builder_append_char(StringBuilder* b, u8 c) {
+    if (!builder_reserve(b, 1)) return 0;
+    b->base.data[b->base.count++] = c;
+    return 1;
+}
+
+
+
+
+/* ==== StringBuilder: Numbers ==== */
+
+// these skip the format parsing, for the hot per-frame text
+
+const char digit_pairs[] = 
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// two digits per division, right to left into the end of a 20 byte buffer, returns the first digit
+u8* u64_to_digits(u64 n, u8* end) {
+    
+    u8* p = end;
+    while (n >= 100) {
+        u32 pair = (n % 100) * 2;
+        n /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (n >= 10) {
+        *--p = digit_pairs[n * 2 + 1];
+        *--p = digit_pairs[n * 2];
+    } else {
+        *--p = '0' + n;
+    }
+    
+    return p;
+}
+
+u64 builder_append_u64(StringBuilder* b, u64 n) {
+    u8  digits[20];
+    u8* first = u64_to_digits(n, digits + 20);
+    return builder_append(b, (String) {first, digits + 20 - first});
+}
+
+u64 builder_append_s64(StringBuilder* b, s64 n) {
+    if (n >= 0) return builder_append_u64(b, n);
+    builder_append_char(b, '-');
+    return 1 + builder_append_u64(b, -(u64) n);
+}
+
+u64 builder_append_hex(StringBuilder* b, u64 n, u8 upper) {
+    
+    char* hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    u8    digits[16];
+    u32   count = 0;
+    do {
+        digits[15 - count++] = hex[n & 15];
+        n >>= 4;
+    } while (n);
+
+    return builder_append(b, (String) {digits + 16 - count, count});
+}
+
+/*
+    fixed point like %.*f: the whole and fraction parts go through the integer path as two u64,
+    exact as long as x * 10^decimals fits in a double's 53 bits, which is every number we put on screen,
+    the rest (and nan, inf) goes to snprintf
+*/
+u64 builder_append_f64(StringBuilder* b, f64 x, u32 decimals) {
+
+    static const f64 limits[10] = {9007199254740992.0, 900719925474099.2, 90071992547409.92, 9007199254740.992, 900719925474.0992, 90071992547.40992, 9007199254.740992, 900719925.4740992, 90071992.54740992, 9007199.254740992};
+
+    f64 a = fabs(x);
+    if (decimals > 9 || !(a < limits[decimals])) {
+        char buffer[512];
+        s32  count = snprintf(buffer, sizeof(buffer), "%.*f", decimals, x);
+        return builder_append(b, (String) {(u8*) buffer, count < (s32) sizeof(buffer) ? count : sizeof(buffer) - 1});
+    }
+
+    static const u64 scales[10] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
     
-    u64 wanted = b->base.count + s.count;
-    while (wanted > b->allocated) {
-        b->base.data = realloc(b->base.data, b->allocated * 2);
-        b->allocated *= 2;
+    u64 scale    = scales[decimals];
+    u64 whole    = (u64) a;
+    f64 scaled   = (a - whole) * scale;
+    u64 fraction = (u64) scaled;
+    f64 rest     = scaled - fraction;
+    if (rest > 0.5) {
+        fraction++;
+    } else if (rest == 0.5) {
+        // the multiply can round onto a half, fma has its exact error, a real half goes to even like printf
+        f64 error = fma(a - whole, scale, -scaled);
+        u64 last  = decimals ? fraction : whole;
+        if (error > 0 || (error == 0 && (last & 1))) fraction++;
+    }
+    if (fraction >= scale) {
+        whole++;
+        fraction -= scale;
+    }
+
+    u8  digits[32];
+    u8* end = digits + 32;
+    u8* p   = end;
+    if (decimals) {
+        u8* first = u64_to_digits(fraction, end);
+        while (end - first < decimals) *--first = '0';
+        p    = first;
+        *--p = '.';
+    }
+    p = u64_to_digits(whole, p);
+    if (signbit(x)) *--p = '-'; // -0 too, like printf
+
+    return builder_append(b, (String) {p, end - p});
+}
+
+
+
+
+/* ==== StringBuilder: Format ==== */
+
+// integer precision, zeros in front of the digits written since start until there are at least min of them
+void builder_zero_extend(StringBuilder* b, u64 start, s32 min) {
+
+    u64 count = b->base.count - start;
+    if (min < 0 || (u64) min <= count) return;
+
+    u64 pad = builder_reserve(b, min - count);
+    u8* p   = b->base.data + start;
+    memmove(p + pad, p, count);
+    memset(p, '0', pad);
+    b->base.count += pad;
+}
+
+/*
+    printf in one pass straight into the builder, the common conversions (d i u x X c s f %) have their own
+    paths above, flags, width, precision (also *) and the length modifiers work like printf,
+    e g a o go through snprintf one at a time, no n, no long double
+*/
+u64 builder_vprint(StringBuilder* b, char* format, va_list va) {
+    
+    u64   begin = b->base.count;
+    char* f     = format;
+    
+    while (1) {
+
+        char* run = f;
+        while (*f && *f != '%') f++;
+        if (f > run) builder_append(b, (String) {(u8*) run, f - run});
+        if (!*f) break;
+        f++;
+
+        u8  left = 0, zero = 0, plus = 0, space = 0, alt = 0;
+        s32 width = 0, precision = -1;
+        
+        for (;; f++) {
+            if      (*f == '-') left  = 1;
+            else if (*f == '0') zero  = 1;
+            else if (*f == '+') plus  = 1;
+            else if (*f == ' ') space = 1;
+            else if (*f == '#') alt   = 1;
+            else break;
+        }
+
+        if (*f == '*') {
+            width = va_arg(va, int);
+            if (width < 0) { left = 1; width = -width; }
+            f++;
+        } else {
+            while (*f >= '0' && *f <= '9') width = width * 10 + *f++ - '0';
+        }
+
+        if (*f == '.') {
+            f++;
+            precision = 0;
+            if (*f == '*') {
+                precision = va_arg(va, int);
+                f++;
+            } else {
+                while (*f >= '0' && *f <= '9') precision = precision * 10 + *f++ - '0';
+            }
+        }
+
+        // 'H' is hh, 'q' is ll
+        char length = 0;
+        if      (f[0] == 'h' && f[1] == 'h') { length = 'H'; f += 2; }
+        else if (f[0] == 'l' && f[1] == 'l') { length = 'q'; f += 2; }
+        else if (*f == 'h' || *f == 'l' || *f == 'z' || *f == 'j' || *f == 't' || *f == 'L') length = *f++;
+
+        char conversion = *f;
+        if (!conversion) break;
+        f++;
+
+        u64 start   = b->base.count;
+        u64 prefix  = 0; // sign or 0x, zero padding goes after it
+        u8  numeric = 1;
+        
+        switch (conversion) {
+            
+            case '%': {
+                builder_append_char(b, '%');
+                continue;
+            }
+            
+            case 'c': {
+                builder_append_char(b, (u8) va_arg(va, int));
+                numeric = 0;
+            } break;
+
+            case 's': {
+                char* s = va_arg(va, char*);
+                if (!s) s = "(null)";
+                u64 count = 0;
+                while (s[count] && (precision < 0 || count < (u64) precision)) count++;
+                builder_append(b, (String) {(u8*) s, count});
+                numeric = 0;
+            } break;
+
+            case 'd': 
+            case 'i': {
+                s64 n;
+                switch (length) {
+                    case 'H': n = (s8)  va_arg(va, int);       break;
+                    case 'h': n = (s16) va_arg(va, int);       break;
+                    case 'l': n = va_arg(va, long);            break;
+                    case 'q': 
+                    case 'j': n = va_arg(va, long long);       break;
+                    case 'z': 
+                    case 't': n = (s64) va_arg(va, size_t);    break;
+                    default:  n = va_arg(va, int);             break;
+                }
+                if      (n < 0) builder_append_char(b, '-');
+                else if (plus)  builder_append_char(b, '+');
+                else if (space) builder_append_char(b, ' ');
+                prefix = b->base.count - start;
+
+                if (precision >= 0) zero = 0;
+                if (precision || n) builder_append_u64(b, n < 0 ? -(u64) n : (u64) n);
+                builder_zero_extend(b, start + prefix, precision);
+            } break;
+
+            case 'u': 
+            case 'o': 
+            case 'x': 
+            case 'X': {
+                u64 n;
+                switch (length) {
+                    case 'H': n = (u8)  va_arg(va, unsigned int);       break;
+                    case 'h': n = (u16) va_arg(va, unsigned int);       break;
+                    case 'l': n = va_arg(va, unsigned long);            break;
+                    case 'q': 
+                    case 'j': n = va_arg(va, unsigned long long);       break;
+                    case 'z': 
+                    case 't': n = va_arg(va, size_t);                   break;
+                    default:  n = va_arg(va, unsigned int);             break;
+                }
+                if (precision >= 0) zero = 0;
+                if (conversion == 'o') {
+                    char buffer[32];
+                    s32  count = snprintf(buffer, sizeof(buffer), alt ? "%#.*llo" : "%.*llo", precision, n);
+                    builder_append(b, (String) {(u8*) buffer, count});
+                    break;
+                }
+
+                if (alt && n && conversion != 'u') builder_append(b, conversion == 'x' ? string("0x") : string("0X"));
+                prefix = b->base.count - start;
+
+                if (precision || n) {
+                    if (conversion == 'u') builder_append_u64(b, n);
+                    else                   builder_append_hex(b, n, conversion == 'X');
+                }
+                builder_zero_extend(b, start + prefix, precision);
+            } break;
+
+            case 'f': 
+            case 'F': {
+                f64 x = va_arg(va, double);
+                if      (!signbit(x) && plus)  builder_append_char(b, '+');
+                else if (!signbit(x) && space) builder_append_char(b, ' ');
+                builder_append_f64(b, x, precision < 0 ? 6 : precision);
+                prefix = signbit(x) || plus || space;
+            } break;
+
+            case 'p': {
+                char buffer[32];
+                s32  count = snprintf(buffer, sizeof(buffer), "%p", va_arg(va, void*));
+                builder_append(b, (String) {(u8*) buffer, count});
+                numeric = 0;
+            } break;
+
+            case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                
+                char  spec[16] = "%";
+                char* p        = spec + 1;
+                if (left)  *p++ = '-';
+                if (zero)  *p++ = '0';
+                if (plus)  *p++ = '+';
+                if (space) *p++ = ' ';
+                if (alt)   *p++ = '#';
+                *p++ = '*';
+                *p++ = '.';
+                *p++ = '*';
+                *p++ = conversion;
+                *p   = 0;
+
+                char buffer[512];
+                s32  count = snprintf(buffer, sizeof(buffer), spec, width, precision, va_arg(va, double));
+                
+                builder_append(b, (String) {(u8*) buffer, count < (s32) sizeof(buffer) ? count : sizeof(buffer) - 1});
+                continue; // snprintf did the width
+            }
+
+            default: {
+                continue; // not a conversion, dropped like printf would
+            }
+        }
+
+        // width, 0 pads after the prefix
+        u64 written = b->base.count - start;
+        if ((u64) width > written) {
+            
+            u64 pad = builder_reserve(b, width - written);
+            u8* p   = b->base.data + start;
+            
+            if (left) {
+                memset(p + written, ' ', pad);
+            } else {
+                if (!zero || !numeric) prefix = 0;
+                memmove(p + prefix + pad, p + prefix, written - prefix);
+                memset(p + prefix, zero && numeric ? '0' : ' ', pad);
+            }
+            b->base.count += pad;
+        }
     }
 
-    for (u64 i = 0; i < s.count; i++)  b->base.data[b->base.count + i] = s.data[i];
-    b->base.count = wanted;
+    return b->base.count - begin;
+}
 
-    return s.count;
+u64 builder_print(StringBuilder* b, char* format, ...) {
+    va_list va;
+    va_start(va, format);
+    u64 count = builder_vprint(b, format, va);
+    va_end(va);
+    return count;
 }
 
 
@@ -197,36 +1362,487 @@ void print(String s) {
     }
 }
 
+// formats straight onto the top of the temp arena, then takes what it used, 0 terminated
 String temp_print(char* s, ...) {
     
-    va_list va, va2;
-    va_start(va, s);
-    va_copy(va2, va);
-    
-    u64 count  = vsnprintf(0, 0, s, va);
-    String out = {temp_alloc(count + 1), count};
-    vsnprintf((char*) out.data, count + 1, s, va2);
+    ArenaBuffer*  a = &runtime.temp_buffer;
+    StringBuilder b;
+    builder_init_fixed(&b, a->data + a->allocated, a->size - a->allocated - 1);
 
+    va_list va;
+    va_start(va, s);
+    builder_vprint(&b, s, va);
     va_end(va);
-    va_end(va2);
+
+    String out = {temp_alloc(b.base.count + 1), b.base.count};
+    out.data[out.count] = 0;
     
     return out;
 }
 
-// naive search for now
+/*
+    first and last byte filter: compare 16 candidate starts at once against b's first and last byte,
+    only the starts where both match get a memcmp of the middle, so most of a is read once, 16 bytes at a time.
+    the last few starts, and machines without SSE2, take the plain loop
+*/
 String string_find(String a, String b) {
     
     if (!a.count || !b.count || !a.data || !b.data || (b.count > a.count)) return (String) {0};
 
-    for (u64 i = 0; i < a.count - b.count + 1; i++) {
-            
-        for (u64 j = 0; j < b.count; j++) {
-            if (a.data[i + j] != b.data[j]) goto next;
-        }
+    u64 last = a.count - b.count; // last possible start
+    u64 i    = 0;
+
+    #ifdef __SSE2__
+    __m128i first_byte = _mm_set1_epi8(b.data[0]);
+    __m128i last_byte  = _mm_set1_epi8(b.data[b.count - 1]);
+    
+    for (; i + 16 <= last + 1; i += 16) {
         
-        return (String) {a.data + i, a.count - i};
-        next: continue;
+        __m128i first_block = _mm_loadu_si128((__m128i*) (a.data + i));
+        __m128i last_block  = _mm_loadu_si128((__m128i*) (a.data + i + b.count - 1));
+        u32     mask        = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first_block, first_byte), _mm_cmpeq_epi8(last_block, last_byte)));
+        
+        while (mask) {
+            u32 bit = __builtin_ctz(mask);
+            if (b.count <= 2 || !memcmp(a.data + i + bit + 1, b.data + 1, b.count - 2)) {
+                return (String) {a.data + i + bit, a.count - i - bit};
+            }
+            mask &= mask - 1;
+        }
+    }
+    #endif
+
+    for (; i <= last; i++) {
+        if (a.data[i] == b.data[0] && !memcmp(a.data + i + 1, b.data + 1, b.count - 1)) {
+            return (String) {a.data + i, a.count - i};
+        }
     }
     
     return (String) {0};
 }
+
+// every match, not overlapping, each is the rest of a from there like string_find(), on the temp arena
+Array(String) string_find_all(String a, String b) {
+    
+    // the results go one after another on the top of the arena, string_find() allocates nothing in between
+    Array(String) out = {(String*) (runtime.temp_buffer.data + runtime.temp_buffer.allocated), 0};
+    if (!b.count) return out;
+
+    String rest = a;
+    while (1) {
+        String found = string_find(rest, b);
+        if (!found.data) break;
+        *(String*) temp_alloc(sizeof(String)) = found;
+        out.count++;
+        rest = (String) {found.data + b.count, found.count - b.count};
+    }
+
+    return out;
+}
+
+// the pieces between separators, empty pieces included, so there is always one more than separators, on the temp arena
+Array(String) string_split(String a, String separator) {
+    
+    Array(String) out = {(String*) (runtime.temp_buffer.data + runtime.temp_buffer.allocated), 0};
+
+    String rest = a;
+    while (1) {
+        String found = separator.count ? string_find(rest, separator) : (String) {0};
+        if (!found.data) break;
+        *(String*) temp_alloc(sizeof(String)) = (String) {rest.data, found.data - rest.data};
+        out.count++;
+        rest = (String) {found.data + separator.count, found.count - separator.count};
+    }
+    *(String*) temp_alloc(sizeof(String)) = rest;
+    out.count++;
+
+    return out;
+}
+
+
+
+
+/* ==== Hash ==== */
+
+// not SIMD, the keys we hash are names, a few words long, so 8 bytes a step is already all of it
+
+u64 rotate_left(u64 x, u32 n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+// splitmix64's finalizer, every input bit reaches every output bit
+u64 hash_u64(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+// murmur3 style mixing, 8 bytes at a time, the tail goes in as one last partial word
+u64 string_hash(String s) {
+    
+    u64 h = 0x9e3779b97f4a7c15 ^ s.count;
+    u64 i = 0;
+    
+    for (; i + 8 <= s.count; i += 8) {
+        u64 k;
+        memcpy(&k, s.data + i, 8);
+        k *= 0x87c37b91114253d5;
+        k  = rotate_left(k, 31);
+        k *= 0x4cf5ad432745937f;
+        h ^= k;
+        h  = rotate_left(h, 27) * 5 + 0x52dce729;
+    }
+
+    if (i < s.count) {
+        u64 k = 0;
+        memcpy(&k, s.data + i, s.count - i);
+        k *= 0x87c37b91114253d5;
+        k  = rotate_left(k, 31);
+        k *= 0x4cf5ad432745937f;
+        h ^= k;
+    }
+
+    return hash_u64(h);
+}
+
+
+#define scalar_equal(a, b) ((a) == (b))
+
+u8 string_equal(String a, String b) {
+    return a.count == b.count && !memcmp(a.data, b.data, a.count);
+}
+
+
+
+
+/* ==== Map ==== */
+
+/*
+    open addressing hash map, Swiss table style, made per key and value type by Define_Map(Name, Key, Value, hash, equal)
+    which makes Map(Name) and name_map_init/get/put/remove/free, hash(key) gives a u64, equal(a, b) compares two keys.
+
+    besides the entries there is one control byte per slot: top bit set for a free slot (empty or deleted),
+    else the low 7 bits of the hash. a lookup compares 16 control bytes at once and only looks at the keys
+    whose 7 bits match, so a miss almost never touches an entry. groups are probed triangularly, the first
+    MAP_GROUP control bytes are mirrored past the end so a group can start at any slot.
+
+    kept under 7/8 full counting deleted slots, growing rehashes everything into new storage from the map's allocator,
+    so on an arena the old storage stays until the arena resets. pointers from get and put are good until the next put.
+    iterate with map_slot_live() over [0, capacity)
+*/
+
+#define MAP_GROUP   16
+#define MAP_EMPTY   0x80
+#define MAP_DELETED 0xfe
+
+// bit i set where control[i] == tag, for 16 bytes
+u32 map_group_match(u8* control, u8 tag) {
+    #ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) control), _mm_set1_epi8(tag)));
+    #else
+    u32 mask = 0;
+    for (u32 i = 0; i < MAP_GROUP; i++) mask |= (control[i] == tag) << i;
+    return mask;
+    #endif
+}
+
+// bit i set where control[i] is empty or deleted
+u32 map_group_free(u8* control) {
+    #ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((__m128i*) control));
+    #else
+    u32 mask = 0;
+    for (u32 i = 0; i < MAP_GROUP; i++) mask |= (control[i] >> 7) << i;
+    return mask;
+    #endif
+}
+
+void map_set_control(u8* control, u32 capacity, u32 i, u8 c) {
+    control[i] = c;
+    if (i < MAP_GROUP) control[capacity + i] = c;
+}
+
+u8 map_slot_live(u8* control, u32 i) {
+    return !(control[i] & 0x80);
+}
+
+#define Map(Name) Map_ ## Name
+
+#define Define_Map(Name, Key, Value, hash, equal)                                                       \
+                                                                                                        \
+typedef struct {                                                                                        \
+    Key   key;                                                                                          \
+    Value value;                                                                                        \
+} Name ## _MapEntry;                                                                                    \
+                                                                                                        \
+typedef struct {                                                                                        \
+    u8*               control;                                                                          \
+    Name ## _MapEntry* entries;                                                                         \
+    u32               capacity; /* power of 2, at least MAP_GROUP, 0 until the first put */             \
+    u32               count;                                                                            \
+    u32               deleted;                                                                          \
+    Allocator         allocator;                                                                        \
+} Map(Name);                                                                                            \
+                                                                                                        \
+void Name ## _map_init(Map(Name)* m, Allocator allocator) {                                             \
+    *m = (Map(Name)) {.allocator = allocator};                                                          \
+}                                                                                                       \
+                                                                                                        \
+/* slot of the key, or -1 */                                                                            \
+s64 Name ## _map_find(Map(Name)* m, Key key, u64 h) {                                                   \
+                                                                                                        \
+    if (!m->capacity) return -1;                                                                        \
+                                                                                                        \
+    u32 mask = m->capacity - 1;                                                                         \
+    u32 pos  = (h >> 7) & mask;                                                                         \
+                                                                                                        \
+    for (u32 step = MAP_GROUP;; step += MAP_GROUP) {                                                    \
+        u32 match = map_group_match(m->control + pos, h & 0x7f);                                        \
+        while (match) {                                                                                 \
+            u32 i = (pos + __builtin_ctz(match)) & mask;                                                \
+            if (equal(m->entries[i].key, key)) return i;                                                \
+            match &= match - 1;                                                                         \
+        }                                                                                               \
+        if (map_group_match(m->control + pos, MAP_EMPTY)) return -1;                                    \
+        pos = (pos + step) & mask;                                                                      \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+/* first free slot on the key's probe sequence, there always is one under 7/8 */                        \
+u32 Name ## _map_free_slot(Map(Name)* m, u64 h) {                                                       \
+                                                                                                        \
+    u32 mask = m->capacity - 1;                                                                         \
+    u32 pos  = (h >> 7) & mask;                                                                         \
+                                                                                                        \
+    for (u32 step = MAP_GROUP;; step += MAP_GROUP) {                                                    \
+        u32 free = map_group_free(m->control + pos);                                                    \
+        if (free) return (pos + __builtin_ctz(free)) & mask;                                            \
+        pos = (pos + step) & mask;                                                                      \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+void Name ## _map_rehash(Map(Name)* m, u32 capacity) {                                                  \
+                                                                                                        \
+    Map(Name) old = *m;                                                                                 \
+                                                                                                        \
+    m->capacity = capacity;                                                                             \
+    m->count    = old.count;                                                                            \
+    m->deleted  = 0;                                                                                    \
+    m->control  = allocator_alloc(m->allocator, capacity + MAP_GROUP);                                  \
+    m->entries  = allocator_alloc(m->allocator, sizeof(Name ## _MapEntry) * capacity);                  \
+    memset(m->control, MAP_EMPTY, capacity + MAP_GROUP);                                                \
+                                                                                                        \
+    for (u32 i = 0; i < old.capacity; i++) {                                                            \
+        if (!map_slot_live(old.control, i)) continue;                                                   \
+        u64 h = hash(old.entries[i].key);                                                               \
+        u32 s = Name ## _map_free_slot(m, h);                                                           \
+        map_set_control(m->control, capacity, s, h & 0x7f);                                             \
+        m->entries[s] = old.entries[i];                                                                 \
+    }                                                                                                   \
+                                                                                                        \
+    allocator_free(m->allocator, old.entries, sizeof(Name ## _MapEntry) * old.capacity);                \
+    allocator_free(m->allocator, old.control, old.capacity + MAP_GROUP);                                \
+}                                                                                                       \
+                                                                                                        \
+/* NULL when it is not there */                                                                         \
+Value* Name ## _map_get(Map(Name)* m, Key key) {                                                        \
+    s64 i = Name ## _map_find(m, key, hash(key));                                                       \
+    return i < 0 ? NULL : &m->entries[i].value;                                                         \
+}                                                                                                       \
+                                                                                                        \
+/* the key's value, a new key gets a zeroed one */                                                      \
+Value* Name ## _map_put(Map(Name)* m, Key key) {                                                        \
+                                                                                                        \
+    u64 h = hash(key);                                                                                  \
+    s64 i = Name ## _map_find(m, key, h);                                                               \
+    if (i >= 0) return &m->entries[i].value;                                                            \
+                                                                                                        \
+    if ((u64) (m->count + m->deleted + 1) * 8 > (u64) m->capacity * 7) {                                \
+        u32 capacity = MAP_GROUP;                                                                       \
+        while ((u64) (m->count + 1) * 16 > (u64) capacity * 7) capacity *= 2; /* under 7/16 after */    \
+        Name ## _map_rehash(m, capacity);                                                               \
+    }                                                                                                   \
+                                                                                                        \
+    u32 s = Name ## _map_free_slot(m, h);                                                               \
+    if (m->control[s] == MAP_DELETED) m->deleted--;                                                     \
+    map_set_control(m->control, m->capacity, s, h & 0x7f);                                              \
+    m->count++;                                                                                         \
+                                                                                                        \
+    Name ## _MapEntry* e = &m->entries[s];                                                              \
+    memset(e, 0, sizeof(*e));                                                                           \
+    e->key = key;                                                                                       \
+    return &e->value;                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+/* returns 0 when it was not there */                                                                   \
+u8 Name ## _map_remove(Map(Name)* m, Key key) {                                                         \
+    s64 i = Name ## _map_find(m, key, hash(key));                                                       \
+    if (i < 0) return 0;                                                                                \
+    map_set_control(m->control, m->capacity, i, MAP_DELETED);                                           \
+    m->count--;                                                                                         \
+    m->deleted++;                                                                                       \
+    return 1;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+void Name ## _map_free(Map(Name)* m) {                                                                  \
+    if (m->capacity) {                                                                                  \
+        allocator_free(m->allocator, m->entries, sizeof(Name ## _MapEntry) * m->capacity);              \
+        allocator_free(m->allocator, m->control, m->capacity + MAP_GROUP);                              \
+    }                                                                                                   \
+    Name ## _map_init(m, m->allocator);                                                                 \
+}                                                                                                       \
+                                                                                                        \
+u8 Name ## _map_remove(Map(Name)* m, Key key) /* takes the ; after Define_Map(), like Define_Array() */ \
+
+
+
+
+/* ==== Map: Benchmark ==== */
+
+Define_Map(bench, u32, u32, hash_u64, scalar_equal);
+
+// map against a linear scan of a key array, u32 keys, hits only, at the sizes our tables have, see --bench-map
+void map_benchmark() {
+
+    u32 sizes[] = {4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+    u32 lookups = 1 << 22;
+
+    u32* keys  = heap_alloc(sizeof(u32) * 4096,    ALLOC_DEBUG);
+    u32* order = heap_alloc(sizeof(u32) * lookups, ALLOC_DEBUG);
+    
+    logprint("[Map] %8s %12s %12s\n", "size", "linear ns", "map ns");
+
+    for (u32 s = 0; s < length_of(sizes); s++) {
+
+        u32 n = sizes[s];
+        
+        Map(bench) m;
+        bench_map_init(&m, heap_allocator(ALLOC_DEBUG));
+        for (u32 i = 0; i < n; i++) {
+            keys[i] = hash_u64(i + 1) | 1; // spread out, never 0
+            *bench_map_put(&m, keys[i]) = i;
+        }
+        for (u32 i = 0; i < lookups; i++) order[i] = keys[hash_u64(i) % n];
+
+        volatile u64 sink = 0;
+        
+        clock_t start = clock();
+        for (u32 i = 0; i < lookups; i++) {
+            u32 key = order[i];
+            for (u32 j = 0; j < n; j++) {
+                if (keys[j] == key) { sink += j; break; }
+            }
+        }
+        f64 linear = (clock() - start) / (f64) CLOCKS_PER_SEC;
+        
+        start = clock();
+        for (u32 i = 0; i < lookups; i++) sink += *bench_map_get(&m, order[i]);
+        f64 map = (clock() - start) / (f64) CLOCKS_PER_SEC;
+
+        logprint("[Map] %8u %12f %12f\n", n, linear * 1e9 / lookups, map * 1e9 / lookups);
+        bench_map_free(&m);
+    }
+
+    heap_free(keys);
+    heap_free(order);
+}
+
+
+
+/* ==== Intern ==== */
+
+/*
+    every distinct String gets one u32 ID for the life of the program, compare and hash the ID from then on.
+    the bytes are copied into chunks that never move or free, 0 terminated so they go straight to C APIs,
+    the table is open addressing, linear probing, kept under half full, and keeps each string's hash so growing never rehashes.
+    ID 0 is the empty string, so a zeroed name means no name.
+    main thread only
+*/
+
+#define INTERN_CHUNK_SIZE (64 * 1024)
+
+struct {
+    ArenaBuffer storage; // current chunk, full ones are left where they are
+    String*     strings; // by ID
+    u32*        hashes;  // by ID, the low 32 bits of string_hash()
+    u32         count;
+    u32         allocated;
+    u32*        slots;   // IDs, 0 is empty
+    u32         slot_count;
+} interns;
+
+void intern_insert_slot(u32 id) {
+    u32 mask = interns.slot_count - 1;
+    u32 i    = interns.hashes[id] & mask;
+    while (interns.slots[i]) i = (i + 1) & mask;
+    interns.slots[i] = id;
+}
+
+u32 intern(String s) {
+
+    if (!s.count) return 0;
+    
+    if (!interns.slots) {
+        interns.allocated  = 256;
+        interns.strings    = heap_alloc(sizeof(String) * interns.allocated, ALLOC_STRING);
+        interns.hashes     = heap_alloc(sizeof(u32)    * interns.allocated, ALLOC_STRING);
+        interns.slot_count = 512;
+        interns.slots      = heap_alloc_zero(sizeof(u32) * interns.slot_count, ALLOC_STRING);
+        interns.strings[0] = (String) {(u8*) "", 0};
+        interns.hashes[0]  = 0;
+        interns.count      = 1;
+    }
+
+    u32 hash = string_hash(s);
+    u32 mask = interns.slot_count - 1;
+    u32 i    = hash & mask;
+    
+    for (u32 id; (id = interns.slots[i]); i = (i + 1) & mask) {
+        String t = interns.strings[id];
+        if (interns.hashes[id] == hash && t.count == s.count && !memcmp(t.data, s.data, s.count)) return id;
+    }
+
+    // new, copy the bytes
+    ArenaBuffer* a = &interns.storage;
+    if (a->allocated + s.count + 1 >= a->size) {
+        u64 size = s.count + 1 < INTERN_CHUNK_SIZE ? INTERN_CHUNK_SIZE : s.count + 2;
+        *a = (ArenaBuffer) {heap_alloc(size, ALLOC_STRING), size};
+    }
+    u8* data = arena_alloc(a, s.count + 1);
+    memcpy(data, s.data, s.count);
+    data[s.count] = 0;
+
+    if (interns.count == interns.allocated) {
+        interns.allocated *= 2;
+        interns.strings    = heap_realloc(interns.strings, sizeof(String) * interns.allocated, ALLOC_STRING);
+        interns.hashes     = heap_realloc(interns.hashes,  sizeof(u32)    * interns.allocated, ALLOC_STRING);
+    }
+
+    u32 id = interns.count++;
+    interns.strings[id] = (String) {data, s.count};
+    interns.hashes[id]  = hash;
+    interns.slots[i]    = id;
+
+    if (interns.count * 2 > interns.slot_count) {
+        heap_free(interns.slots);
+        interns.slot_count *= 2;
+        interns.slots       = heap_alloc_zero(sizeof(u32) * interns.slot_count, ALLOC_STRING);
+        for (u32 j = 1; j < interns.count; j++) intern_insert_slot(j);
+    }
+
+    return id;
+}
+
+u32 intern_c_string(char* s) {
+    return intern((String) {(u8*) s, strlen(s)});
+}
+
+// 0 terminated, good for as long as the program runs
+String intern_string(u32 id) {
+    if (!id) return (String) {(u8*) "", 0};
+    assert(id < interns.count);
+    return interns.strings[id];
+}